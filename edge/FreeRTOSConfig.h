@@ -68,7 +68,14 @@
 #define configMESSAGE_BUFFER_LENGTH_TYPE        size_t
 
 /* Memory allocation related definitions. */
+/* The banked memory layout creates the pinned tasks on stacks in scratch RAM,
+the kernel keeps providing the idle and timer task memory. */
+#if defined(MEMORY_BANKED) && MEMORY_BANKED
+#define configSUPPORT_STATIC_ALLOCATION         1
+#define configKERNEL_PROVIDED_STATIC_MEMORY     1
+#else
 #define configSUPPORT_STATIC_ALLOCATION         0
+#endif
 #define configSUPPORT_DYNAMIC_ALLOCATION        1
 #define configTOTAL_HEAP_SIZE                   (128*1024)
 #define configAPPLICATION_ALLOCATED_HEAP        0
@@ -81,6 +88,10 @@
 /* Run time and task stats gathering related definitions. */
 #define configGENERATE_RUN_TIME_STATS           0
 #define configUSE_TRACE_FACILITY                1
+/* Lets the stack profile work out each stack's size */
+#if defined(mainSTACK_PROFILE) && mainSTACK_PROFILE
+#define configRECORD_STACK_HIGH_ADDRESS         1
+#endif
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
 /* Software timer related definitions. */
@@ -99,7 +110,11 @@
 /* SMP port only */
 #define configNUMBER_OF_CORES                   2
 #define configTICK_CORE                         0
-#define configRUN_MULTIPLE_PRIORITIES           0
+/* The vibration task runs above everything else, pinned to core 1. With 0
+the scheduler only runs tasks of the highest ready priority at once, so
+core 0 would sit idle for as long as the FFT runs instead of sampling and
+sending. */
+#define configRUN_MULTIPLE_PRIORITIES           1
 #if configNUMBER_OF_CORES > 1
 #define configUSE_CORE_AFFINITY                 1 
 #endif
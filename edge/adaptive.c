@@ -0,0 +1,67 @@
+#include "adaptive.h"
+
+// Weight of a new sample in the running mean and variance, 1/8
+#define ADAPTIVE_SHIFT 3
+
+static uint32_t isqrt32(uint32_t x) {
+    uint32_t res = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > x) bit >>= 2;
+    while (bit != 0) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return res;
+}
+
+static uint32_t activity(AdaptiveState *state, uint32_t value) {
+    if (!state->_primed) {
+        state->_mean = (int32_t) value << 4;
+        state->_variance = 0;
+        state->_last = value;
+        state->_primed = true;
+        return 0;
+    }
+
+    state->_mean += (((int32_t) value << 4) - state->_mean) >> ADAPTIVE_SHIFT;
+    int32_t dev = (int32_t) value - (state->_mean >> 4);
+    uint32_t square = (uint32_t) (dev * dev);
+    if (square >= state->_variance) {
+        state->_variance += (square - state->_variance) >> ADAPTIVE_SHIFT;
+    } else {
+        state->_variance -= (state->_variance - square) >> ADAPTIVE_SHIFT;
+    }
+
+    uint32_t slope = value > state->_last ? value - state->_last : state->_last - value;
+    state->_last = value;
+
+    uint32_t deviation = isqrt32(state->_variance);
+    return slope > deviation ? slope : deviation;
+}
+
+uint32_t adaptiveUpdate(AdaptiveState *state, uint32_t value, uint32_t periodMs, uint32_t maxRatePerMin) {
+    if (activity(state, value) > state->threshold) {
+        periodMs /= 2;
+        state->_calm = 0;
+    } else if (++state->_calm >= state->calmSamples) {
+        periodMs += periodMs / 4;
+        state->_calm = 0;
+    }
+
+    uint32_t minPeriodMs = state->minPeriodMs;
+    if (maxRatePerMin) {
+        uint32_t budgetPeriodMs = (60000 + maxRatePerMin - 1) / maxRatePerMin;
+        if (budgetPeriodMs > minPeriodMs) {
+            minPeriodMs = budgetPeriodMs;
+        }
+    }
+
+    if (periodMs < minPeriodMs) periodMs = minPeriodMs;
+    if (periodMs > state->maxPeriodMs) periodMs = state->maxPeriodMs;
+    return periodMs;
+}
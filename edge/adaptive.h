@@ -0,0 +1,27 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Variance/slope driven sample period controller for one stream. The period
+// is halved as soon as the signal moves and grows back slowly while it is
+// steady, always between minPeriodMs and maxPeriodMs.
+typedef struct AdaptiveState {
+    uint32_t minPeriodMs;
+    uint32_t maxPeriodMs;
+    uint32_t threshold;         // change in stream units that counts as moving
+    uint8_t calmSamples;        // steady samples before backing off
+
+    int32_t _mean;              // Q4
+    uint32_t _variance;
+    uint32_t _last;
+    uint8_t _calm;
+    bool _primed;
+} AdaptiveState;
+
+// Feeds one sample and returns the next period. maxRatePerMin caps the
+// rate this stream may use, 0 means no cap.
+uint32_t adaptiveUpdate(AdaptiveState *state, uint32_t value, uint32_t periodMs, uint32_t maxRatePerMin);
+
+#endif //ADAPTIVE_H
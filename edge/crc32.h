@@ -0,0 +1,10 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Standard CRC-32 (IEEE 802.3), bitwise so it needs no table
+uint32_t crc32(const void *data, size_t len);
+
+#endif //CRC32_H
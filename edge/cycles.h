@@ -0,0 +1,19 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <stdint.h>
+#include <hardware/structs/systick.h>
+
+// SysTick counts CPU cycles down on the core that reads it, the FreeRTOS
+// port runs it from the processor clock. Good for spans shorter than a
+// tick period, at most one reload is crossed.
+static inline uint32_t cyclesNow(void) {
+    return systick_hw->cvr;
+}
+
+static inline uint32_t cyclesSince(uint32_t start) {
+    const uint32_t now = systick_hw->cvr;
+    return start >= now ? start - now : start + systick_hw->rvr + 1 - now;
+}
+
+#endif //CYCLES_H
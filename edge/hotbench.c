@@ -0,0 +1,61 @@
+#include "hotbench.h"
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+#include <hardware/structs/xip_ctrl.h>
+
+#include "cycles.h"
+
+#define HOTBENCH_ROUNDS 2000
+
+typedef struct BenchResult {
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t cycles;
+} BenchResult;
+
+// In RAM whatever the build, so only the case itself pays for misses.
+// Interrupts are off so the tick and cyw43 cannot land inside a sample.
+static uint32_t __not_in_flash_func(timeOnce)(void (*run)(void), bool cold) {
+    const uint32_t irq = save_and_disable_interrupts();
+    if (cold) {
+        // Reading back waits for the flush to finish
+        xip_ctrl_hw->flush = 1;
+        (void) xip_ctrl_hw->flush;
+    }
+    const uint32_t start = cyclesNow();
+    run();
+    const uint32_t cycles = cyclesSince(start);
+    restore_interrupts(irq);
+    return cycles;
+}
+
+static void measure(const HotBenchCase *benchCase, bool cold, BenchResult *result) {
+    *result = (BenchResult) { .minCycles = UINT32_MAX };
+    for (uint32_t round = 0; round < HOTBENCH_ROUNDS; round++) {
+        const uint32_t cycles = timeOnce(benchCase->run, cold);
+        result->cycles += cycles;
+        if (cycles < result->minCycles) result->minCycles = cycles;
+        if (cycles > result->maxCycles) result->maxCycles = cycles;
+    }
+}
+
+void hotBenchRun(const HotBenchCase *cases, size_t count) {
+#if defined(HOT_PATH_IN_RAM) && HOT_PATH_IN_RAM
+    printf("Hot path benchmark, code in RAM, %d rounds\n", HOTBENCH_ROUNDS);
+#else
+    printf("Hot path benchmark, code in flash, %d rounds\n", HOTBENCH_ROUNDS);
+#endif
+    for (size_t i = 0; i < count; i++) {
+        for (int cold = 1; cold >= 0; cold--) {
+            BenchResult result;
+            measure(&cases[i], cold, &result);
+            printf("  %s %s: min %lu cycles, avg %lu, max %lu\n",
+                   cases[i].name, cold ? "cold" : "warm",
+                   (unsigned long) result.minCycles,
+                   (unsigned long) (result.cycles / HOTBENCH_ROUNDS),
+                   (unsigned long) result.maxCycles);
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef HOTBENCH_H
+#define HOTBENCH_H
+
+#include <stddef.h>
+
+typedef struct HotBenchCase {
+    const char *name;
+    void (*run)(void);
+} HotBenchCase;
+
+// Times each case with the XIP cache flushed first, which is what cyw43
+// traffic leaves behind at worst, and again with it warm. Prints min,
+// average and worst cycles per call. Call from a task on core 0, built in
+// with HOT_PATH_BENCH=1. Run an image with RAM_HOT_PATH=1 and one without
+// to compare.
+void hotBenchRun(const HotBenchCase *cases, size_t count);
+
+#endif //HOTBENCH_H
@@ -0,0 +1,18 @@
+#ifndef HOTPATH_H
+#define HOTPATH_H
+
+#include <pico.h>
+
+// Acquisition code that runs on every sample: the stream reads, the SPI
+// register accessors of the sensors and the sampler's per sample work.
+// Built into SRAM with RAM_HOT_PATH=1 in Cmake so a miss in the XIP cache,
+// after cyw43 traffic evicted the lines, cannot stall it. ADC and DMA ISRs
+// belong here too. The SDK's SPI transfers and the inline gpio and adc
+// helpers are already in RAM. Costs SRAM, so keep the list short.
+#if defined(HOT_PATH_IN_RAM) && HOT_PATH_IN_RAM
+#define HOT_PATH(name) __not_in_flash_func(name)
+#else
+#define HOT_PATH(name) name
+#endif
+
+#endif //HOTPATH_H
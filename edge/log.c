@@ -0,0 +1,136 @@
+#include "log.h"
+
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+
+#include "task.h"
+
+// Frames on the wire, mixed with plain text which never contains 0xFF:
+// 0xFF, info, token (4), time (4), args (4 each), all little endian.
+// info holds the level in bits 0-1, the core in bit 2 and the argument
+// count in bits 4-7. Token 0 reports dropped records in its argument.
+#define LOG_FRAME_START 0xFF
+#define LOG_HEADER_WORDS 3
+
+typedef struct LogRing {
+    uint32_t words[LOG_RING_WORDS];
+    // Only the owning core moves head, only the drain task moves tail
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+} LogRing;
+
+static LogRing rings[2];
+static volatile uint8_t runtimeLevel = LOG_LEVEL;
+
+void logWrite(uint8_t level, const char *format, const uint32_t *args, uint8_t count) {
+    if (level > runtimeLevel) {
+        return;
+    }
+    if (count > LOG_MAX_ARGS) {
+        count = LOG_MAX_ARGS;
+    }
+
+    const uint32_t needed = LOG_HEADER_WORDS + count;
+
+    // Only interrupts on this core can interleave with us. The core is read
+    // with them masked, before that the scheduler may still move the task
+    // to the other core, whose ring that core could be writing to.
+    const uint32_t irq = save_and_disable_interrupts();
+    const uint core = get_core_num();
+    LogRing *ring = &rings[core];
+    const uint32_t head = ring->head;
+    if (LOG_RING_WORDS - (head - ring->tail) < needed) {
+        ring->dropped++;
+        restore_interrupts(irq);
+        return;
+    }
+
+    ring->words[head % LOG_RING_WORDS] = level | (core << 2) | ((uint32_t) count << 4);
+    ring->words[(head + 1) % LOG_RING_WORDS] = (uint32_t) (uintptr_t) format;
+    ring->words[(head + 2) % LOG_RING_WORDS] = time_us_32();
+    for (uint8_t i = 0; i < count; i++) {
+        ring->words[(head + LOG_HEADER_WORDS + i) % LOG_RING_WORDS] = args[i];
+    }
+    // The record must be complete before the drain task can see it
+    __dmb();
+    ring->head = head + needed;
+    restore_interrupts(irq);
+}
+
+void logSetLevel(uint8_t level) {
+    runtimeLevel = level > LOG_LEVEL_DEBUG ? LOG_LEVEL_DEBUG : level;
+}
+
+uint8_t logGetLevel(void) {
+    return runtimeLevel;
+}
+
+static inline uint8_t *putWord(uint8_t *out, uint32_t word) {
+    *out++ = (uint8_t) word;
+    *out++ = (uint8_t) (word >> 8);
+    *out++ = (uint8_t) (word >> 16);
+    *out++ = (uint8_t) (word >> 24);
+    return out;
+}
+
+static void writeFrame(uint32_t info, uint32_t token, uint32_t time, const uint32_t *args) {
+    uint8_t frame[2 + 4 * (LOG_HEADER_WORDS - 1 + LOG_MAX_ARGS)];
+    const uint8_t count = (uint8_t) (info >> 4);
+    uint8_t *out = frame;
+    *out++ = LOG_FRAME_START;
+    *out++ = (uint8_t) info;
+    out = putWord(out, token);
+    out = putWord(out, time);
+    for (uint8_t i = 0; i < count; i++) {
+        out = putWord(out, args[i]);
+    }
+    // One call holds the stdout lock for the whole frame
+    stdio_put_string((const char *) frame, (int) (out - frame), false, false);
+}
+
+static void drainRing(LogRing *ring, uint core) {
+    uint32_t tail = ring->tail;
+    const uint32_t head = ring->head;
+    __dmb();
+    while (tail != head) {
+        const uint32_t info = ring->words[tail % LOG_RING_WORDS];
+        const uint32_t token = ring->words[(tail + 1) % LOG_RING_WORDS];
+        const uint32_t time = ring->words[(tail + 2) % LOG_RING_WORDS];
+        const uint8_t count = (uint8_t) (info >> 4);
+        uint32_t args[LOG_MAX_ARGS];
+        for (uint8_t i = 0; i < count; i++) {
+            args[i] = ring->words[(tail + LOG_HEADER_WORDS + i) % LOG_RING_WORDS];
+        }
+        writeFrame(info, token, time, args);
+        tail += LOG_HEADER_WORDS + count;
+    }
+    __dmb();
+    ring->tail = tail;
+
+    // The counter is only ever reset here, losing a concurrent increment
+    // only under reports
+    const uint32_t dropped = ring->dropped;
+    if (dropped) {
+        ring->dropped = 0;
+        writeFrame(LOG_LEVEL_WARN | (core << 2) | (1 << 4), 0, time_us_32(), &dropped);
+    }
+}
+
+static void prvLogTask(void *pvParameters) {
+    (void) pvParameters;
+    for (;;) {
+        drainRing(&rings[0], 0);
+        drainRing(&rings[1], 1);
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_PERIOD_MS));
+    }
+}
+
+bool logStart(UBaseType_t priority, uint32_t stackWords) {
+    return xTaskCreate(prvLogTask,
+                       "Log",
+                       stackWords,
+                       NULL,
+                       priority,
+                       NULL) == pdPASS;
+}
@@ -0,0 +1,54 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+
+// Calls above this level are compiled out, may be set from Cmake
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_MAX_ARGS 8
+// Per core ring, in 32 bit words
+#define LOG_RING_WORDS 512
+#define LOG_DRAIN_PERIOD_MS 20
+
+// Logging never formats on the device. Each call stores the address of its
+// format string, a timestamp and up to LOG_MAX_ARGS 32 bit arguments in the
+// ring of the calling core, tools/logdecode.py turns them back into text
+// using the format strings the linker put in .fogberry_log.
+// %s only works for strings in flash, cast them with (uintptr_t). 64 bit
+// arguments are not supported.
+#define LOG_AT(level, fmt, ...) do { \
+        if ((level) <= LOG_LEVEL) { \
+            static const char logFormat[] __attribute__((section(".fogberry_log"), used)) = fmt; \
+            const uint32_t logArgs[] = {0, ##__VA_ARGS__}; \
+            logWrite((level), logFormat, &logArgs[1], sizeof(logArgs) / sizeof(logArgs[0]) - 1); \
+        } \
+    } while (0)
+
+#define LOG_ERROR(fmt, ...) LOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)  LOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)  LOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+
+// Safe from any task or ISR on either core, never blocks. Records that do
+// not fit are counted and reported by the drain task.
+void logWrite(uint8_t level, const char *format, const uint32_t *args, uint8_t count);
+
+// Runtime threshold, only levels at or below it are recorded
+void logSetLevel(uint8_t level);
+uint8_t logGetLevel(void);
+
+// Starts the task that writes the rings to stdout
+bool logStart(UBaseType_t priority, uint32_t stackWords);
+
+#endif //LOG_H
@@ -85,6 +85,22 @@
 #define PPP_DEBUG                   LWIP_DBG_OFF
 #define SLIP_DEBUG                  LWIP_DBG_OFF
 #define DHCP_DEBUG                  LWIP_DBG_OFF
-#define MEMP_NUM_SYS_TIMEOUT            (LWIP_NUM_SYS_TIMEOUT_INTERNAL+3)
+#define MEMP_NUM_SYS_TIMEOUT            (LWIP_NUM_SYS_TIMEOUT_INTERNAL+6)
+
+// SNTP hands the server time to timesync.c which keeps the epoch offset
+#define SNTP_SERVER_DNS             1
+#define SNTP_STARTUP_DELAY          0
+#define SNTP_UPDATE_DELAY           (15 * 60 * 1000)
+#include <stdint.h>
+void timesyncSet(uint32_t sec, uint32_t us);
+#define SNTP_SET_SYSTEM_TIME_US(sec, us) timesyncSet(sec, us)
+
+// MQTT over TLS, the mbedTLS settings are in mbedtls_config.h
+#if defined(mainMQTT_TLS) && mainMQTT_TLS
+#define LWIP_ALTCP                  1
+#define LWIP_ALTCP_TLS              1
+#define LWIP_ALTCP_TLS_MBEDTLS      1
+#define ALTCP_MBEDTLS_AUTHMODE      MBEDTLS_SSL_VERIFY_REQUIRED
+#endif
 
 #endif /* __LWIPOPTS_H__ */
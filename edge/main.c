@@ -15,14 +15,50 @@
 #include "pico/cyw43_arch.h"
 #include "hardware/spi.h"
 #include "mfrc522.h"
+#include "rfid.h"
+#include "mpu9250.h"
+#include "vibration.h"
+#include "storage.h"
+#include "sampler.h"
+#include "units.h"
+#include "mq7.h"
+#include "topics.h"
+#include "timesync.h"
+#include "log.h"
+#include "wifi.h"
+#include "transport.h"
+#include "pool.h"
+#include "memory.h"
+#include "hotpath.h"
 #include "lwipopts.h"
 #include "lwip/apps/mqtt.h"
 #include "lwip/apps/mqtt_priv.h" // needed to set hostname
+#include "lwip/timeouts.h"
 #include "pico/unique_id.h"
 #include "hardware/irq.h"
+#include "hardware/watchdog.h"
+#include "hardware/structs/watchdog.h"
 
 #include "main.h"
 
+#if mainMQTT_TLS
+#include "tls.h"
+/* MQTT_TLS_CA_CERT, written by tools/tls_certs.sh */
+#include mainMQTT_CA_CERT_INC
+#endif
+#if mainMQTT_SN
+#include "mqttsn.h"
+#endif
+#if mainPOOL_BENCH
+#include "poolbench.h"
+#endif
+#if mainHOT_PATH_BENCH
+#include "hotbench.h"
+#endif
+#if mainSTACK_PROFILE
+#include "stackprof.h"
+#endif
+
 /*-----------------------------------------------------------*/
 
 /*
@@ -30,9 +66,9 @@
  */
 static void prvSetupHardware( void );
 
-static void prvLightSensorTask( void *pvParameters );
-static void prvGasSensorTask( void *pvParameters );
 static void prvQueueSendTask( void *pvParameters );
+static void prvVibrationTask( void *pvParameters );
+static void prvHealthTask( void *pvParameters );
 
 /* Prototypes for the standard FreeRTOS callback/hook functions implemented
 within this file. */
@@ -43,24 +79,133 @@ void vApplicationTickHook( void );
 
 /*-----------------------------------------------------------*/
 
-static QueueHandle_t lightQueue = NULL;
-static QueueHandle_t gasQueue = NULL;
+static QueueHandle_t vibrationQueue = NULL;
 
 /*-----------------------------------------------------------*/
 
 MFRC522Ptr_t mfrc;
+/* Entrance readers, mfrc is the in reader and also unlocks the device. */
+static MFRC522Ptr_t readers[mainMFRC522_READERS];
+static const char *const reader_names[mainMFRC522_READERS] = { "in", "out" };
+static QueueHandle_t doorQueue = NULL;
+static MPU9250 mpu;
+static bool mpuReady = false;
+/* Set from the MQTT callback, serviced by the vibration task that owns the IMU. */
+static volatile bool imuCalibrationRequested = false;
+/* Set when a units setting arrived over MQTT, the send task stores them. */
+static volatile bool unitsCalibrationChanged = false;
 static MQTT_CLIENT_DATA_T state;
+/* How often the queue send task checks the streams, changeable over MQTT. */
+static volatile TickType_t send_interval = mainQUEUE_SEND_FREQUENCY_MS;
+/* Last time each task went round its loop, checked by the health task. */
+static volatile TickType_t send_heartbeat;
+static volatile TickType_t vibration_heartbeat;
+/* Set by prvSetupHardware after a watchdog reset. */
+static bool warm_boot = false;
+/* Set by prvSetupHardware when the firmware rebooted itself while unlocked. */
+static bool still_unlocked = false;
+/* Milliseconds since boot at which each phase finished, 0 until then. */
+static volatile uint32_t boot_phase_ms[mainBOOT_PHASE_COUNT];
 char client_id_buf[sizeof(MQTT_DEVICE_NAME) + 5];
 
+#define mainTOPIC_NAME(id, name) [id] = name,
+static const char *const topic_names[mainTOPIC_COUNT] = {
+    mainTOPIC_TABLE(mainTOPIC_NAME)
+};
+
 /*-----------------------------------------------------------*/
 
-uint16_t read_analog_pin(uint8_t adc_pin)
+uint16_t HOT_PATH(read_analog_pin)(uint8_t adc_pin)
 {
     adc_select_input(adc_pin);
     uint16_t raw_value = adc_read();
     return raw_value;
 }
 
+static bool HOT_PATH(read_adc_stream)(const SamplerStream *stream, uint32_t *value)
+{
+    *value = read_analog_pin(stream->channel);
+    return true;
+}
+
+/* The MQ-7 only reads CO at the end of its low heater phase, readings
+anywhere else are dropped here. */
+static bool HOT_PATH(read_gas_stream)(const SamplerStream *stream, uint32_t *value)
+{
+    if (!mq7InWindow(time_us_64()))
+    {
+        return false;
+    }
+    return read_adc_stream(stream, value);
+}
+
+static uint32_t HOT_PATH(light_to_lux)(SamplerStream *stream, uint32_t counts)
+{
+    ( void ) stream;
+    return unitsLightLux(counts);
+}
+
+/* The MQ-7 is compensated with the air temperature, read from the RP2040's
+own sensor next to each gas reading. A single reading of it is noisy, so
+filterState keeps an average of the counts in Q4, 0 until the first one. */
+static uint32_t HOT_PATH(gas_to_ppm)(SamplerStream *stream, uint32_t counts)
+{
+    const int32_t temperature = (int32_t) read_analog_pin(UNITS_TEMPERATURE_INPUT) << 4;
+    int32_t average = (int32_t) stream->filterState;
+    average = average ? average + (temperature - average) / 8 : temperature;
+    stream->filterState = (uint32_t) average;
+    return unitsGasPpm(counts, unitsAmbient((uint32_t) average >> 4));
+}
+
+static AdaptiveState light_adaptive = {
+    .minPeriodMs = mainADAPTIVE_MIN_PERIOD_MS,
+    .maxPeriodMs = mainADAPTIVE_MAX_PERIOD_MS,
+    .threshold = mainADAPTIVE_LIGHT_THRESHOLD,
+    .calmSamples = mainADAPTIVE_CALM_SAMPLES,
+};
+
+static AdaptiveState gas_adaptive = {
+    .minPeriodMs = mainADAPTIVE_MIN_PERIOD_MS,
+    .maxPeriodMs = mainGAS_MAX_PERIOD_MS,
+    .threshold = mainADAPTIVE_GAS_THRESHOLD,
+    .calmSamples = mainADAPTIVE_CALM_SAMPLES,
+};
+
+/* Every periodically sampled sensor, serviced by the single sampler task. */
+static SamplerStream streams[mainSTREAM_COUNT] = {
+    [mainSTREAM_LIGHT] = {
+        .name = "light",
+        .topic = mainTOPIC_LIGHT,
+        .read = read_adc_stream,
+        .channel = mainADA161_LIGHT_SENSOR_ADC_PIN,
+        .filter = light_to_lux,
+        .unit = "lux",
+        .period = mainSENSOR_SAMPLE_FREQUENCY_MS,
+        .batchSize = mainQUEUE_THRESHOLD,
+        .deadband = mainLIGHT_DEADBAND,
+        .maxSilence = mainLIGHT_HEARTBEAT_MS,
+        .forwardRaw = true,
+        .aggregateTopic = mainTOPIC_LIGHT_AGGREGATE,
+        .statsTopic = mainTOPIC_LIGHT_STATS,
+        .adaptive = &light_adaptive,
+    },
+    [mainSTREAM_GAS] = {
+        .name = "gas",
+        .topic = mainTOPIC_GAS,
+        .read = read_gas_stream,
+        .channel = mainMQ7_GAS_SENSOR_ADC_PIN,
+        .filter = gas_to_ppm,
+        .unit = "ppm",
+        .period = mainSENSOR_SAMPLE_FREQUENCY_MS,
+        .batchSize = mainQUEUE_THRESHOLD,
+        .aggregateWindow = mainGAS_AGGREGATE_WINDOW_MS,
+        .forwardRaw = false,
+        .aggregateTopic = mainTOPIC_GAS_AGGREGATE,
+        .statsTopic = mainTOPIC_GAS_STATS,
+        .adaptive = &gas_adaptive,
+    },
+};
+
 bool authenticate_card()
 {
     // Declare card UID's
@@ -79,6 +224,49 @@ bool authenticate_card()
     }
 }
 
+/* Reads the badge blocks block by block, the way the dump functions do, and
+then with one authentication per sector, and prints both timings. */
+static void read_badge( void )
+{
+    static const uint8_t blocks[] = mainBADGE_BLOCKS;
+    static const MIFARE_Key keys[] = mainBADGE_KEYS;
+    const uint8_t count = sizeof(blocks) / sizeof(blocks[0]);
+    const uint8_t keyCount = sizeof(keys) / sizeof(keys[0]);
+    uint8_t data[sizeof(blocks) * 16];
+    MIFARE_ReadStats_t oneByOne, batched;
+
+    const PICC_Type type = PICC_GetType(mfrc->uid.sak);
+    if (type != PICC_TYPE_MIFARE_MINI && type != PICC_TYPE_MIFARE_1K && type != PICC_TYPE_MIFARE_4K)
+    {
+        return;
+    }
+
+    StatusCode status = MIFARE_ReadBlocksOneByOne(mfrc, &(mfrc->uid), blocks, count, keys, keyCount, data, &oneByOne);
+    if (status == STATUS_OK)
+    {
+        status = MIFARE_ReadBlocks(mfrc, &(mfrc->uid), blocks, count, keys, keyCount, data, &batched);
+    }
+    PICC_HaltA(mfrc);
+    PCD_StopCrypto1(mfrc);
+    if (status != STATUS_OK)
+    {
+        printf("Badge read failed: %s\n\r", GetStatusCodeName(status));
+        return;
+    }
+
+    printf("Badge, %u blocks: one by one %lu us (%u auths, %lu us reading), "
+           "per sector %lu us (%u auths, %lu us reading)\n\r",
+           count, oneByOne.totalUs, oneByOne.auths, oneByOne.readUs,
+           batched.totalUs, batched.auths, batched.readUs);
+    for (uint8_t i = 0; i < count; i++) {
+        printf("  %3u:", blocks[i]);
+        for (uint8_t j = 0; j < 16; j++) {
+            printf(" %02x", data[i * 16 + j]);
+        }
+        printf("\n\r");
+    }
+}
+
 void read_new_card( void )
 {
     //Wait for new card
@@ -90,8 +278,9 @@ void read_new_card( void )
     PICC_ReadCardSerial(mfrc);
 
     //Show UID on serial monitor
-    printf("PICC dump: \n\r");
-    PICC_DumpToSerial(mfrc, &(mfrc->uid));
+    printf("PICC details: \n\r");
+    PICC_DumpDetailsToSerial(&(mfrc->uid));
+    read_badge();
 
     printf("Uid is: ");
     for(int i = 0; i < 4; i++) {
@@ -99,60 +288,569 @@ void read_new_card( void )
     } printf("\n\r");
 }
 
-static const char *full_topic(MQTT_CLIENT_DATA_T *state, const char *name) {
-    static char full_topic[MQTT_TOPIC_LEN];
-    snprintf(full_topic, sizeof(full_topic), "/%s%s", state->mqtt_client_info.client_id, name);
-    return full_topic;
-    return name;
+static void boot_mark(int phase)
+{
+    if (!boot_phase_ms[phase])
+    {
+        boot_phase_ms[phase] = to_ms_since_boot(get_absolute_time());
+    }
+}
+
+/* Resets through the watchdog instead of halting, so the samples the
+sampler retained are published after the restart. Safe from any context. */
+static void prvReboot( uint32_t reason )
+{
+    watchdog_hw->scratch[ mainREBOOT_SCRATCH ] = mainREBOOT_MAGIC | reason;
+    watchdog_reboot( 0, 0, mainREBOOT_DELAY_MS );
+    for( ;; )
+    {
+        tight_loop_contents();
+    }
+}
+
+// For the few topics that are not in the topic table, built once
+static void build_topic(MQTT_CLIENT_DATA_T *state, const char *name, char *out, size_t len) {
+    snprintf(out, len, "/%s%s", state->mqtt_client_info.client_id, name);
 }
 
 static void pub_request_cb(__unused void *arg, err_t err) {
     if (err != 0) {
-        printf("pub_request_cb failed %d", err);
-        exit(1);
+        LOG_ERROR("pub_request_cb failed %d", err);
+        prvReboot(mainREBOOT_PUBLISH);
+    }
+}
+
+static void sub_request_cb(void *arg, err_t err) {
+    MQTT_CLIENT_DATA_T* state = (MQTT_CLIENT_DATA_T*)arg;
+    if (err != 0) {
+        LOG_WARN("subscribe request failed %d", err);
+        return;
+    }
+    state->subscribe_count++;
+}
+
+static bool parse_u32(const char *text, uint32_t *value) {
+    char *end;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if (end == text || *end != '\0') {
+        return false;
+    }
+    *value = (uint32_t) parsed;
+    return true;
+}
+
+static SamplerStream *find_stream(const char *name, size_t len) {
+    for (int stream = 0; stream < mainSTREAM_COUNT; stream++) {
+        if (strlen(streams[stream].name) == len && strncmp(streams[stream].name, name, len) == 0) {
+            return &streams[stream];
+        }
+    }
+    return NULL;
+}
+
+// Runs in the lwIP callback, only stores single words
+static bool handle_config(const char *setting, const char *payload) {
+    uint32_t value;
+    if (!parse_u32(payload, &value)) {
+        return false;
+    }
+
+    if (strcmp(setting, "send_interval_ms") == 0) {
+        if (value < mainCONFIG_MIN_PERIOD_MS || value > mainCONFIG_MAX_PERIOD_MS) {
+            return false;
+        }
+        send_interval = pdMS_TO_TICKS(value);
+        return true;
+    }
+    if (strcmp(setting, "sample_budget_per_min") == 0) {
+        samplerSetBudget(value);
+        return true;
+    }
+    if (strcmp(setting, "log_level") == 0) {
+        logSetLevel(value);
+        return true;
+    }
+    if (strncmp(setting, "units/", 6) == 0) {
+        if (!unitsConfigure(setting + 6, value)) {
+            return false;
+        }
+        unitsCalibrationChanged = true;
+        return true;
+    }
+
+    const char *slash = strchr(setting, '/');
+    if (!slash) {
+        return false;
+    }
+    SamplerStream *stream = find_stream(setting, slash - setting);
+    if (!stream) {
+        return false;
+    }
+    const char *key = slash + 1;
+
+    if (strcmp(key, "period_ms") == 0) {
+        if (value < mainCONFIG_MIN_PERIOD_MS || value > mainCONFIG_MAX_PERIOD_MS) {
+            return false;
+        }
+        stream->period = pdMS_TO_TICKS(value);
+        samplerKick();
+    } else if (strcmp(key, "batch") == 0) {
+        if (value < 1 || value > mainQUEUE_LENGTH) {
+            return false;
+        }
+        stream->batchSize = value;
+    } else if (strcmp(key, "deadband") == 0) {
+        stream->deadband = value;
+    } else if (strcmp(key, "deadband_permille") == 0) {
+        stream->deadbandPermille = value;
+    } else if (strcmp(key, "heartbeat_ms") == 0) {
+        if (value != 0 && value < mainCONFIG_MIN_PERIOD_MS) {
+            return false;
+        }
+        stream->maxSilence = pdMS_TO_TICKS(value);
+    } else if (strcmp(key, "aggregate_window_ms") == 0) {
+        if (value != 0 && value < mainCONFIG_MIN_PERIOD_MS) {
+            return false;
+        }
+        stream->aggregateWindow = pdMS_TO_TICKS(value);
+    } else if (strcmp(key, "raw") == 0) {
+        stream->forwardRaw = value != 0;
+    } else if (stream->adaptive && strcmp(key, "min_period_ms") == 0) {
+        if (value < mainCONFIG_MIN_PERIOD_MS || value > stream->adaptive->maxPeriodMs) {
+            return false;
+        }
+        stream->adaptive->minPeriodMs = value;
+    } else if (stream->adaptive && strcmp(key, "max_period_ms") == 0) {
+        if (value < stream->adaptive->minPeriodMs || value > mainCONFIG_MAX_PERIOD_MS) {
+            return false;
+        }
+        stream->adaptive->maxPeriodMs = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void handle_command(MQTT_CLIENT_DATA_T *state, const char *name) {
+    if (strcmp(name, MQTT_RECALIBRATE_COMMAND) == 0) {
+        if (mpuReady) {
+            imuCalibrationRequested = true;
+        }
+    } else if (strncmp(name, MQTT_CONFIG_TOPIC "/", sizeof(MQTT_CONFIG_TOPIC)) == 0) {
+        const char *setting = name + sizeof(MQTT_CONFIG_TOPIC);
+        if (!handle_config(setting, state->data)) {
+            printf("Rejected config %s=%s\n", setting, state->data);
+        }
+    } else {
+        printf("Unknown command %s\n", name);
+    }
+}
+
+static void mqtt_incoming_publish_cb(void *arg, const char *topic, u32_t tot_len) {
+    MQTT_CLIENT_DATA_T* state = (MQTT_CLIENT_DATA_T*)arg;
+    ( void ) tot_len;
+    strncpy(state->topic, topic, sizeof(state->topic) - 1);
+    state->topic[sizeof(state->topic) - 1] = '\0';
+    state->len = 0;
+}
+
+static void mqtt_incoming_data_cb(void *arg, const u8_t *data, u16_t len, u8_t flags) {
+    MQTT_CLIENT_DATA_T* state = (MQTT_CLIENT_DATA_T*)arg;
+
+    // Payloads are short, anything beyond the buffer is cut off
+    uint32_t space = sizeof(state->data) - 1 - state->len;
+    uint32_t copy = len < space ? len : space;
+    memcpy(&state->data[state->len], data, copy);
+    state->len += copy;
+    state->data[state->len] = '\0';
+
+    if (!(flags & MQTT_DATA_FLAG_LAST)) {
+        return;
+    }
+
+#if MQTT_UNIQUE_TOPIC
+    const char *basic_topic = state->topic + strlen(state->mqtt_client_info.client_id) + 1;
+#else
+    const char *basic_topic = state->topic;
+#endif
+    handle_command(state, basic_topic);
+}
+
+// The lwIP client copies every publish into its output ring, the block
+// goes back to the pool right after
+static char *mqtt_transport_reserve(void *ctx, size_t size, size_t *capacity) {
+    (void) ctx;
+    *capacity = size;
+    return poolAllocSize(size);
+}
+
+static bool mqtt_transport_send(void *ctx, TopicId topic, const char *payload, size_t len) {
+    MQTT_CLIENT_DATA_T* state = (MQTT_CLIENT_DATA_T*)ctx;
+    cyw43_arch_lwip_begin();
+    err_t err = mqtt_publish(state->mqtt_client_inst, topicGet(topic), payload, len, MQTT_PUBLISH_QOS, MQTT_PUBLISH_RETAIN, pub_request_cb, state);
+    cyw43_arch_lwip_end();
+    poolFreeBlock((void *) payload);
+    return err == ERR_OK;
+}
+
+static const Transport mqtt_transport = { "MQTT", mqtt_transport_reserve, mqtt_transport_send, &state };
+
+#if mainMQTT_SN
+// Payloads are written into the retransmission window and sent from there
+static char *mqttsn_transport_reserve(void *ctx, size_t size, size_t *capacity) {
+    (void) ctx;
+    return mqttsnReserve(size, capacity, mainMQTTSN_WINDOW_WAIT_MS);
+}
+
+// Predefined topic ids are the topic table index plus one, 0 is reserved.
+// tools/mqttsn_gateway.py reads the same table from main.h.
+static bool mqttsn_transport_send(void *ctx, TopicId topic, const char *payload, size_t len) {
+    (void) ctx;
+    (void) payload;
+    return mqttsnSend(topic + 1, len);
+}
+
+static const Transport mqttsn_transport = { "MQTT-SN", mqttsn_transport_reserve, mqttsn_transport_send, NULL };
+#endif
+
+static const Transport *transport = &mqtt_transport;
+
+// Where the next payload is formatted, in the transport's own buffer.
+// Must be followed by publish_payload.
+static char *reserve_payload(TopicId topic, size_t size, size_t *capacity) {
+    char *payload = transport->reserve(transport->ctx, size, capacity);
+    if (!payload) {
+        LOG_WARN("%s has no room for %s", (uintptr_t) transport->name, (uintptr_t) topic_names[topic]);
+    }
+    return payload;
+}
+
+// False when the transport did not take the payload
+static bool publish_payload(MQTT_CLIENT_DATA_T *state, TopicId topic, const char *payload) {
+    (void) state;
+    const size_t len = strlen(payload);
+    LOG_DEBUG("Publishing %lu bytes to %s", len, (uintptr_t) topic_names[topic]);
+    if (!transport->send(transport->ctx, topic, payload, len)) {
+        LOG_WARN("%s publish to %s failed", (uintptr_t) transport->name, (uintptr_t) topic_names[topic]);
+        return false;
+    }
+    boot_mark(mainBOOT_PUBLISH);
+    return true;
+}
+
+// snprintf returns what it would have written, keeps chained writes in the
+// buffer when one was cut short
+static inline int clamp_len(int len, size_t capacity) {
+    return len < (int) capacity ? len : (int) capacity - 1;
+}
+
+// Appends ";t=<epoch ms>" once the clock has been synced, converting at
+// publish time so samples taken before the first sync still get a stamp.
+// Nothing for samples recovered after a reset, their time is unknown.
+static int append_timestamp(char *out, size_t len, uint64_t captured_us) {
+    if (!captured_us) {
+        return 0;
+    }
+    uint64_t epoch_us = timesyncEpochUs(captured_us);
+    if (!epoch_us) {
+        return 0;
+    }
+    return snprintf(out, len, ";t=%llu", epoch_us / 1000);
+}
+
+// Appends ";u=<unit>" for streams that convert their readings, and for
+// the gas stream where the MQ-7 heater was: ";ph=<phase>;cy=<cycle>;po=<s
+// into the phase>", so the receiver can check it was read in the window
+static int append_stream_fields(char *out, size_t len, const SamplerStream *stream, uint64_t captured_us) {
+    int written = 0;
+    if (stream->unit) {
+        written = clamp_len(snprintf(out, len, ";u=%s", stream->unit), len);
+    }
+    Mq7PhaseInfo heater;
+    if (stream->read == read_gas_stream && mq7PhaseAt(captured_us, &heater)) {
+        written += snprintf(out + written, len - written, ";ph=%s;cy=%lu;po=%lu",
+                            mq7PhaseName(heater.phase), heater.cycle, heater.offsetMs / 1000);
+        written = clamp_len(written, len);
+    }
+    return written;
+}
+
+// "<value>" or, after readings were suppressed by the deadband,
+// "<value>;s=<suppressed>;h=<held value>" so the receiver can rebuild
+// the step-hold series, followed by ";q=<sequence number>" and the
+// stream's own fields. False when it was not handed to the transport.
+static bool publish_sample(MQTT_CLIENT_DATA_T *state, const SamplerStream *stream, const Sample *sample) {
+    size_t capacity;
+    char *temp_str = reserve_payload(stream->topic, 120, &capacity);
+    if (!temp_str) {
+        return false;
+    }
+    int len;
+    if (sample->suppressed) {
+        len = snprintf(temp_str, capacity, "%lu;s=%lu;h=%lu;q=%lu", sample->value, sample->suppressed, sample->held, sample->seq);
+    } else {
+        len = snprintf(temp_str, capacity, "%lu;q=%lu", sample->value, sample->seq);
+    }
+    len = clamp_len(len, capacity);
+    len += append_stream_fields(temp_str + len, capacity - len, stream, sample->capturedUs);
+    append_timestamp(temp_str + len, capacity - len, sample->capturedUs);
+    return publish_payload(state, stream->topic, temp_str);
+}
+
+// False when it was not handed to the transport
+static bool publish_aggregate(MQTT_CLIENT_DATA_T *state, const SamplerStream *stream, const Aggregate *agg) {
+    size_t capacity;
+    char *temp_str = reserve_payload(stream->aggregateTopic, 128, &capacity);
+    if (!temp_str) {
+        return false;
+    }
+    int len = snprintf(temp_str, capacity, "n=%lu;min=%lu;max=%lu;sum=%llu;sq=%llu;q=%lu",
+                       agg->count, agg->min, agg->max, agg->sum, agg->sumSquares, agg->seq);
+    len = clamp_len(len, capacity);
+    // the heater phase where the window started, stamped with its end
+    len += append_stream_fields(temp_str + len, capacity - len, stream, agg->firstUs);
+    append_timestamp(temp_str + len, capacity - len, agg->lastUs);
+    return publish_payload(state, stream->aggregateTopic, temp_str);
+}
+
+// Next sequence number and how many samples and windows were lost to full
+// queues, so receivers can tell edge drops from losses further down
+static void publish_stats(MQTT_CLIENT_DATA_T *state, const SamplerStream *stream) {
+    size_t capacity;
+    char *temp_str = reserve_payload(stream->statsTopic, 48, &capacity);
+    if (!temp_str) {
+        return;
+    }
+    snprintf(temp_str, capacity, "q=%lu;drop=%lu;aggdrop=%lu",
+             stream->sequence, stream->dropped, stream->aggregatesDropped);
+    publish_payload(state, stream->statsTopic, temp_str);
+}
+
+// Milliseconds since boot at the end of each phase, fast=1 when the cached
+// access point and lease were used
+static void publish_boot_profile(MQTT_CLIENT_DATA_T *state) {
+    size_t capacity;
+    char *temp_str = reserve_payload(mainTOPIC_BOOT, 96, &capacity);
+    if (!temp_str) {
+        return;
+    }
+    snprintf(temp_str, capacity, "hw=%lu;wifi=%lu;dhcp=%lu;connack=%lu;pub=%lu;fast=%d",
+             boot_phase_ms[mainBOOT_HW], wifiJoinedAtMs(), wifiBoundAtMs(),
+             boot_phase_ms[mainBOOT_CONNACK], boot_phase_ms[mainBOOT_PUBLISH], wifiUsedCache());
+    publish_payload(state, mainTOPIC_BOOT, temp_str);
+}
+
+#if mainMQTT_TLS
+// What the last (re)connect cost: milliseconds from TCP connect to CONNACK,
+// heap held by the connection and the peak during the handshake, and
+// whether a cached session was offered for resumption. Resumed connects
+// show up as a much shorter connect_ms.
+static void publish_tls_stats(MQTT_CLIENT_DATA_T *state, const TlsStats *stats) {
+    size_t capacity;
+    char *temp_str = reserve_payload(mainTOPIC_TLS, 80, &capacity);
+    if (!temp_str) {
+        return;
+    }
+    snprintf(temp_str, capacity, "connect_ms=%lu;heap=%lu;heap_peak=%lu;offered=%d;n=%lu",
+             stats->connectMs, stats->heapBytes, stats->heapPeakBytes, stats->sessionOffered, stats->connects);
+    publish_payload(state, mainTOPIC_TLS, temp_str);
+}
+#endif
+
+#if mainMQTT_SN
+// Acknowledged, retransmitted and refused MQTT-SN publishes since boot
+static void publish_transport_stats(MQTT_CLIENT_DATA_T *state) {
+    MqttSnStats stats;
+    mqttsnGetStats(&stats);
+    size_t capacity;
+    char *temp_str = reserve_payload(mainTOPIC_TRANSPORT, 96, &capacity);
+    if (!temp_str) {
+        return;
     }
+    snprintf(temp_str, capacity, "sent=%lu;retry=%lu;ack=%lu;nack=%lu;full=%lu;reconnect=%lu",
+             stats.sent, stats.retries, stats.acked, stats.rejected, stats.windowFull, stats.reconnects);
+    publish_payload(state, mainTOPIC_TRANSPORT, temp_str);
+}
+#endif
+
+// Free heap now and at its lowest, then per pool class
+// "<block size>:<free>:<lowest free>:<failed allocs>"
+static void publish_memory_stats(MQTT_CLIENT_DATA_T *state) {
+    // Taken before the payload takes a block of its own
+    PoolStats stats[POOL_CLASS_COUNT];
+    for (uint8_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        poolClassStats(i, &stats[i]);
+    }
+
+    size_t capacity;
+    char *temp_str = reserve_payload(mainTOPIC_MEMORY, 96, &capacity);
+    if (!temp_str) {
+        return;
+    }
+    int len = snprintf(temp_str, capacity, "heap=%u;heapmin=%u;pool=",
+                       xPortGetFreeHeapSize(), xPortGetMinimumEverFreeHeapSize());
+    for (uint8_t i = 0; i < POOL_CLASS_COUNT && len < (int) capacity; i++) {
+        len += snprintf(temp_str + len, capacity - len, "%s%u:%u:%u:%lu", i ? "," : "",
+                        stats[i].blockSize, stats[i].free, stats[i].minFree, stats[i].failures);
+    }
+    publish_payload(state, mainTOPIC_MEMORY, temp_str);
+}
+
+// Contested accesses per second for SRAM0..5, with the layout built in so
+// runs before and after MEMORY_LAYOUT=banked can be told apart
+static void publish_bus_stats(MQTT_CLIENT_DATA_T *state) {
+    uint32_t contested[MEMORY_SRAM_BANKS];
+    memoryContention(mainBUS_WINDOW_MS, contested);
+
+    size_t capacity;
+    char *temp_str = reserve_payload(mainTOPIC_BUS, 80, &capacity);
+    if (!temp_str) {
+        return;
+    }
+    int len = snprintf(temp_str, capacity, "banked=%d;sram=", MEMORY_BANKED);
+    for (uint8_t i = 0; i < MEMORY_SRAM_BANKS && len < (int) capacity; i++) {
+        len += snprintf(temp_str + len, capacity - len, "%s%lu", i ? "," : "", contested[i]);
+    }
+    publish_payload(state, mainTOPIC_BUS, temp_str);
 }
 
-static void publish_value(MQTT_CLIENT_DATA_T *state, char topic[], uint32_t value) {
-    const char *topic_key = full_topic(state, topic);
-    char temp_str[32];
-    snprintf(temp_str, sizeof(temp_str), "%ld", value);
-    printf("Publishing %s to %s\n", temp_str, topic_key);
-    mqtt_publish(state->mqtt_client_inst, topic_key, temp_str, strlen(temp_str), MQTT_PUBLISH_QOS, MQTT_PUBLISH_RETAIN, pub_request_cb, state);
+// One per card read: "reader=<in|out>;uid=<hex>;at=<ms since boot>".
+// False when it was not handed to the transport.
+static bool publish_door_event(MQTT_CLIENT_DATA_T *state, const RfidEvent *event) {
+    size_t capacity;
+    char *temp_str = reserve_payload(mainTOPIC_DOOR, 64, &capacity);
+    if (!temp_str) {
+        return false;
+    }
+    int len = snprintf(temp_str, capacity, "reader=%s;uid=", reader_names[event->reader]);
+    for (uint8_t i = 0; i < event->uidSize && len < (int) capacity; i++) {
+        len += snprintf(temp_str + len, capacity - len, "%02x", event->uid[i]);
+    }
+    if (len < (int) capacity) {
+        snprintf(temp_str + len, capacity - len, ";at=%lu", event->atMs);
+    }
+    return publish_payload(state, mainTOPIC_DOOR, temp_str);
 }
 
+static void reconnect_cb(void *arg);
+
 static void mqtt_connection_cb(mqtt_client_t *client, void *arg, mqtt_connection_status_t status) {
     MQTT_CLIENT_DATA_T* state = (MQTT_CLIENT_DATA_T*)arg;
     if (status == MQTT_CONNECT_ACCEPTED) {
         state->connect_done = true;
+        boot_mark(mainBOOT_CONNACK);
+#if mainMQTT_TLS
+        tlsConnected(client->conn);
+#endif
 
         // indicate online
         if (state->mqtt_client_info.will_topic) {
             mqtt_publish(state->mqtt_client_inst, state->mqtt_client_info.will_topic, "1", 1, MQTT_WILL_QOS, true, pub_request_cb, state);
         }
 
+#if MQTT_SHORT_TOPICS
+        // tell subscribers what the short topics stand for
+        static char alias_topic[MQTT_TOPIC_LEN];
+        static char alias_table[MQTT_OUTPUT_RINGBUF_SIZE / 2];
+        build_topic(state, MQTT_ALIAS_TOPIC, alias_topic, sizeof(alias_topic));
+        size_t alias_len = topicsAliasTable(alias_table, sizeof(alias_table));
+        mqtt_publish(state->mqtt_client_inst, alias_topic, alias_table, alias_len, MQTT_PUBLISH_QOS, true, pub_request_cb, state);
+#endif
+
+        // listen for commands
+        static char command_topic[MQTT_TOPIC_LEN];
+        build_topic(state, MQTT_COMMAND_TOPIC "/#", command_topic, sizeof(command_topic));
+        mqtt_subscribe(state->mqtt_client_inst, command_topic, MQTT_SUBSCRIBE_QOS, sub_request_cb, state);
+
+        // and for settings, retained ones are delivered right away
+        static char config_topic[MQTT_TOPIC_LEN];
+        build_topic(state, MQTT_CONFIG_TOPIC "/#", config_topic, sizeof(config_topic));
+        mqtt_subscribe(state->mqtt_client_inst, config_topic, MQTT_SUBSCRIBE_QOS, sub_request_cb, state);
+
+    } else if (state->connect_done) {
+        // Lost an established connection, a silent link loss shows up as a
+        // keepalive timeout. Samples keep queueing meanwhile.
+        LOG_WARN("MQTT connection lost (%d), reconnecting", status);
+        sys_timeout(mainMQTT_RECONNECT_MS, reconnect_cb, state);
     } else if (status == MQTT_CONNECT_DISCONNECTED) {
-        if (!state->connect_done) {
-            panic("Failed to connect to mqtt server");
-        }
+        prvReboot(mainREBOOT_MQTT_CONNECT);
+    } else {
+        prvReboot(mainREBOOT_MQTT_STATUS);
     }
-    else {
-        panic("Unexpected status");
+}
+
+// In lwIP context. With TLS the cached session is offered again, so a
+// reconnect skips the full handshake.
+static err_t connect_client(MQTT_CLIENT_DATA_T *state) {
+#if mainMQTT_TLS
+    const u16_t port = MQTT_TLS_PORT;
+#else
+    const u16_t port = MQTT_PORT;
+#endif
+    err_t err = mqtt_client_connect(state->mqtt_client_inst, &state->mqtt_server_address, port, mqtt_connection_cb, state, &state->mqtt_client_info);
+#if mainMQTT_TLS
+    if (err == ERR_OK) {
+        tlsConnecting(state->mqtt_client_inst->conn, mainMQTT_TLS_HOSTNAME);
+    }
+#endif
+    return err;
+}
+
+static void reconnect_cb(void *arg) {
+    MQTT_CLIENT_DATA_T* state = (MQTT_CLIENT_DATA_T*)arg;
+    if (connect_client(state) != ERR_OK) {
+        sys_timeout(mainMQTT_RECONNECT_MS, reconnect_cb, state);
+    }
+}
+
+#if mainMQTT_SN
+static void mqttsn_connected_cb(void *arg) {
+    (void) arg;
+    boot_mark(mainBOOT_CONNACK);
+}
+
+static void start_sn_client(MQTT_CLIENT_DATA_T *state) {
+    ip_addr_t gateway;
+    if (!ip4addr_aton(mainMQTTSN_GATEWAY, &gateway)) {
+        printf("ip error\n");
+        return;
+    }
+    printf("Connecting to MQTT-SN gateway at %s\n", ipaddr_ntoa(&gateway));
+    transport = &mqttsn_transport;
+
+    cyw43_arch_lwip_begin();
+    bool started = mqttsnStart(&gateway, mainMQTTSN_PORT, state->mqtt_client_info.client_id, MQTT_KEEP_ALIVE_S, mqttsn_connected_cb, state);
+    cyw43_arch_lwip_end();
+    if (!started) {
+        printf("MQTT-SN client start error\n");
+        prvReboot(mainREBOOT_MQTTSN_START);
     }
 }
+#endif
 
 static void start_client(MQTT_CLIENT_DATA_T *state) {
+#if mainMQTT_TLS
+    state->mqtt_client_info.tls_config = tlsInit((const uint8_t *) MQTT_TLS_CA_CERT, sizeof(MQTT_TLS_CA_CERT), mainSTORAGE_SLOT_TLS);
+    if (!state->mqtt_client_info.tls_config) {
+        printf("TLS config error\n");
+        prvReboot(mainREBOOT_TLS_CONFIG);
+    }
+#else
     printf("Warning: Not using TLS\n");
+#endif
 
     state->mqtt_client_inst = mqtt_client_new();
     if (!state->mqtt_client_inst) {
-        panic("MQTT client instance creation error");
+        printf("MQTT client instance creation error\n");
+        prvReboot(mainREBOOT_MQTT_CLIENT);
     }
+    mqtt_set_inpub_callback(state->mqtt_client_inst, mqtt_incoming_publish_cb, mqtt_incoming_data_cb, state);
     printf("Connecting to mqtt server at %s\n", ipaddr_ntoa(&state->mqtt_server_address));
 
     cyw43_arch_lwip_begin();
-    if (mqtt_client_connect(state->mqtt_client_inst, &state->mqtt_server_address, MQTT_PORT, mqtt_connection_cb, state, &state->mqtt_client_info) != ERR_OK) {
-        panic("MQTT broker connection error");
+    if (connect_client(state) != ERR_OK) {
+        printf("MQTT broker connection error\n");
+        prvReboot(mainREBOOT_MQTT_BROKER);
     }
     cyw43_arch_lwip_end();
 }
@@ -179,8 +877,13 @@ void init_mqtt()
     state.mqtt_client_info.client_user = NULL;
     state.mqtt_client_info.client_pass = NULL;
 
+    if (!topicsInit(client_id_buf, topic_names, mainTOPIC_COUNT, MQTT_SHORT_TOPICS)) {
+        printf("Topic table does not fit\n");
+        prvReboot(mainREBOOT_TOPICS);
+    }
+
     static char will_topic[MQTT_TOPIC_LEN];
-    strncpy(will_topic, full_topic(&state, MQTT_WILL_TOPIC), sizeof(will_topic));
+    build_topic(&state, MQTT_WILL_TOPIC, will_topic, sizeof(will_topic));
     state.mqtt_client_info.will_topic = will_topic;
     state.mqtt_client_info.will_msg = MQTT_WILL_MSG;
     state.mqtt_client_info.will_qos = MQTT_WILL_QOS;
@@ -193,7 +896,8 @@ void init_mqtt()
     }
     state.mqtt_server_address = addr;
 
-    if (cyw43_arch_wifi_connect_timeout_ms(mainWIFI_SSID, mainWIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK, 10000))
+    /* The join was started in prvSetupHardware. */
+    if (!wifiWaitUp(mainWIFI_CONNECT_TIMEOUT_MS))
     {
         printf("Failed to connect\n");
         return;
@@ -206,47 +910,183 @@ void init_mqtt()
         printf("IP address %d.%d.%d.%d\n", ip_address[0], ip_address[1], ip_address[2], ip_address[3]);
     }
 
+    cyw43_arch_lwip_begin();
+    timesyncStart(mainSNTP_SERVER);
+    cyw43_arch_lwip_end();
+
+#if mainMQTT_SN
+    start_sn_client(&state);
+#else
     start_client(&state);
+#endif
+}
+
+#if mainPOOL_BENCH
+static void prvPoolBenchTask( void *pvParameters )
+{
+    ( void ) pvParameters;
+    poolBenchRun();
+    vTaskDelete( NULL );
+}
+#endif
+
+#if mainHOT_PATH_BENCH
+/* The acquisition paths as the sampler and vibration task take them. */
+static void HOT_PATH(bench_adc_read)( void )
+{
+    uint32_t value;
+    read_adc_stream(&streams[0], &value);
+}
+
+static void HOT_PATH(bench_mfrc522_read)( void )
+{
+    ( void ) PCD_ReadRegister(mfrc, VersionReg);
+}
+
+static void HOT_PATH(bench_mpu9250_read)( void )
+{
+    mpu9250ReadAccel(&mpu);
+}
+
+static void prvHotBenchTask( void *pvParameters )
+{
+    static const HotBenchCase cases[] = {
+        { "adc stream read", bench_adc_read },
+        { "PCD_ReadRegister", bench_mfrc522_read },
+        { "mpu9250ReadAccel", bench_mpu9250_read },
+    };
+    ( void ) pvParameters;
+    /* The IMU case goes last so it can be left out without one. */
+    hotBenchRun(cases, mpuReady ? 3 : 2);
+    vTaskDelete( NULL );
+}
+#endif
+
+/* Creates a task pinned to one core. With the banked layout its stack comes
+from that core's scratch bank, away from the striped SRAM the other core uses. */
+static BaseType_t prvCreatePinnedTask( TaskFunction_t task, const char *name, uint32_t stack_words,
+                                       UBaseType_t priority, uint8_t core )
+{
+#if MEMORY_BANKED
+    StackType_t *stack = memoryCoreStack(core, stack_words);
+    StaticTask_t *tcb = stack ? pvPortMalloc(sizeof(StaticTask_t)) : NULL;
+    if (tcb)
+    {
+        return xTaskCreateStaticAffinitySet(task, name, stack_words, NULL, priority,
+                                            stack, tcb, ( 1 << core )) ? pdPASS : pdFAIL;
+    }
+#endif
+    return xTaskCreateAffinitySet(task, name, stack_words, NULL, priority, ( 1 << core ), NULL);
 }
 
 void vLaunch( void )
 {
-    /* Unlock the device after card authentication. */
-    read_new_card();
-    if (!authenticate_card())
+#if mainPOOL_BENCH
+    /* Benchmark image, core 0 because the cycle counts come from its SysTick. */
+    poolClassesInit();
+    xTaskCreateAffinitySet(prvPoolBenchTask,
+                           "PoolBench",
+                           configMINIMAL_STACK_SIZE * 2,
+                           NULL,
+                           mainHEALTH_TASK_PRIORITY,
+                           ( 1 << 0 ),
+                           NULL);
+    vTaskStartScheduler();
+    for( ;; );
+#endif
+#if mainHOT_PATH_BENCH
+    /* Benchmark image, core 0 because the cycle counts come from its SysTick. */
+    xTaskCreateAffinitySet(prvHotBenchTask,
+                           "HotBench",
+                           configMINIMAL_STACK_SIZE * 2,
+                           NULL,
+                           mainHEALTH_TASK_PRIORITY,
+                           ( 1 << 0 ),
+                           NULL);
+    vTaskStartScheduler();
+    for( ;; );
+#endif
+
+    /* Unlock the device after card authentication. After one of its own
+    reboots it was unlocked already and the retained samples have to go out
+    without anyone at the reader. Any other reset asks for the card again. */
+    if (!still_unlocked)
     {
-        return;
+        read_new_card();
+        if (!authenticate_card())
+        {
+            return;
+        }
     }
+    watchdog_hw->scratch[ mainUNLOCK_SCRATCH ] = mainUNLOCK_MAGIC;
+
+    /* Publish buffers come from the block pools, see pool.h. */
+    poolClassesInit();
 
     init_mqtt();
 
     /* Create the queue. */
-	lightQueue = xQueueCreate( mainQUEUE_LENGTH, sizeof( uint32_t ) );
-	gasQueue = xQueueCreate( mainQUEUE_LENGTH, sizeof( uint32_t ) );
+	vibrationQueue = xQueueCreate( 1, sizeof( VibrationFeatures ) );
+    doorQueue = xQueueCreate( mainDOOR_QUEUE_LENGTH, sizeof( RfidEvent ) );
 
     printf("Creating tasks.\n");
-    
-    xTaskCreate(prvLightSensorTask,		     		/* The function that implements the task. */
-                "LightSensor",   					/* The text name assigned to the task - for debug only as it is not used by the kernel. */
-                configMINIMAL_STACK_SIZE, 			/* The size of the stack to allocate to the task. */
+
+    /* Log records are written to the UART by a low priority task. */
+    logStart(mainLOG_TASK_PRIORITY, mainSTACK_WORDS_LOG);
+
+    /* One task samples every stream in the table, each with its own queue. */
+    samplerSetBudget(mainSAMPLE_BUDGET_PER_MIN);
+    if (!samplerStart(streams, mainSTREAM_COUNT, mainQUEUE_LENGTH, mainSAMPLER_TASK_PRIORITY, mainSTACK_WORDS_SAMPLER))
+    {
+        printf("Failed to start sampler\n");
+        return;
+    }
+
+    /* Both entrance readers polled from one task, the send task publishes. */
+    if (!rfidStart(readers, mainMFRC522_READERS, doorQueue, mainRFID_TASK_PRIORITY, mainSTACK_WORDS_RFID))
+    {
+        printf("No entrance reader found\n");
+    }
+
+#if MEMORY_BANKED
+    /* Next to the network stack on core 0, its stack in scratch Y. */
+    prvCreatePinnedTask(prvQueueSendTask,
+                        "QueueSend",
+                        mainSTACK_WORDS_SEND,
+                        mainQUEUE_SEND_TASK_PRIORITY,
+                        0);
+#else
+    xTaskCreate(prvQueueSendTask,		     		/* The function that implements the task. */
+                "QueueSend",     					/* The text name assigned to the task - for debug only as it is not used by the kernel. */
+                mainSTACK_WORDS_SEND, 			    /* The size of the stack to allocate to the task. */
                 NULL, 								/* The parameter passed to the task - not used in this case. */
-                mainLIGHT_SENSOR_TASK_PRIORITY, 	/* The priority assigned to the task. */
+                mainQUEUE_SEND_TASK_PRIORITY, 	    /* The priority assigned to the task. */
                 NULL);								/* The task handle is not required, so NULL is passed. */
+#endif
 
-    xTaskCreate(prvGasSensorTask,
-                "GasSensor",
-                configMINIMAL_STACK_SIZE,
-                NULL,
-                mainGAS_SENSOR_TASK_PRIORITY,
-                NULL);
 
-    xTaskCreate(prvQueueSendTask,
-                "QueueSend",
-                configMINIMAL_STACK_SIZE,
+    xTaskCreate(prvHealthTask,
+                "Health",
+                mainSTACK_WORDS_HEALTH,
                 NULL,
-                mainQUEUE_SEND_TASK_PRIORITY,
+                mainHEALTH_TASK_PRIORITY,
                 NULL);
 
+    if (mpuReady)
+    {
+        /* Pinned so the FFT never competes with the network stack on core 0. */
+        prvCreatePinnedTask(prvVibrationTask,
+                            "Vibration",
+                            mainSTACK_WORDS_VIBRATION,
+                            mainVIBRATION_TASK_PRIORITY,
+                            mainVIBRATION_CORE);
+    }
+
+#if mainSTACK_PROFILE
+    /* Reports every task's high water mark while the rest runs as usual. */
+    stackProfileStart(tskIDLE_PRIORITY, mainSTACK_WORDS_PROFILE, mainSTACK_PROFILE_PERIOD_MS);
+#endif
+
     /* Start the tasks and timer running. */
     vTaskStartScheduler();
 
@@ -258,8 +1098,19 @@ void vLaunch( void )
 
 int main( void )
 {
+#if MEMORY_BANKED
+    /* Heap_5 has no memory until its regions are defined, so this goes first.
+    One task stack per core: QueueSend on core 0, Vibration on core 1. */
+    bool stacks_banked = memoryInit(mainSTACK_WORDS_SEND, mainSTACK_WORDS_VIBRATION);
+#endif
     /* Configure the hardware ready to run the demo. */
     prvSetupHardware();
+#if MEMORY_BANKED
+    if (!stacks_banked)
+    {
+        printf("Task stacks do not fit the scratch banks, using the heap\n");
+    }
+#endif
     const char *rtos_name;
     rtos_name = "FreeRTOS SMP";
 
@@ -276,83 +1127,233 @@ int main( void )
 /*-----------------------------------------------------------*/
 
 // TASKS
-static void prvLightSensorTask( void *pvParameters )
+// False when the transport refused a sample, e.g. the MQTT-SN window is
+// full, there is then no point in offering it more this round
+static bool publishQueue(SamplerStream *stream)
 {
-    TickType_t xNextWakeTime;
+    // Samples queued while publishing stay for the next round. A sample
+    // only leaves the queue, and its retained copy, once the transport took
+    // it, the first failure leaves it and the rest for the next round.
+    Sample sample;
+    int num_elements = uxQueueMessagesWaiting(stream->queue);
+    for (int idx = 0; idx < num_elements && xQueuePeek(stream->queue, &sample, 0U) == pdTRUE; idx++)
+    {
+        vTaskDelay( mainSEND_DELAY_MS );  // Small delay to deliver everything
+        if (!publish_sample(&state, stream, &sample))
+        {
+            return false;
+        }
+        ( void ) xQueueReceive(stream->queue, &sample, 0U);
+        samplerPublished(stream, &sample);
+    }
+    return true;
+}
 
-	/* Remove compiler warning about unused parameter. */
-	( void ) pvParameters;
+// Like publishQueue, a window stays queued until the transport took it.
+// Windows that close meanwhile and find the queue full are counted in
+// aggregatesDropped by the sampler, so /stats still accounts for them.
+static bool publishAggregates(SamplerStream *stream)
+{
+    Aggregate agg;
+    while (xQueuePeek(stream->aggregates, &agg, 0U) == pdTRUE)
+    {
+        if (!publish_aggregate(&state, stream, &agg))
+        {
+            return false;
+        }
+        ( void ) xQueueReceive(stream->aggregates, &agg, 0U);
+        vTaskDelay( mainSEND_DELAY_MS );
+    }
+    return true;
+}
+
+// One window's features in one message, crest is peak / rms * 100 and band
+// the energy per band from DC up. False when it was not handed to the transport
+static bool publishVibration(const VibrationFeatures *features)
+{
+    size_t capacity;
+    char *temp_str = reserve_payload(mainTOPIC_VIBRATION, 128, &capacity);
+    if (!temp_str)
+    {
+        return false;
+    }
+    int len = snprintf(temp_str, capacity, "rms=%lu;peak=%lu;crest=%lu;f_dhz=%lu;band=",
+                       features->rms, features->peak, features->crestFactor, features->peakFreqDeciHz);
+    for (int band = 0; band < VIBRATION_BANDS && len < (int) capacity; band++)
+    {
+        len += snprintf(temp_str + len, capacity - len, "%s%lu", band ? "," : "", features->bandEnergy[band]);
+    }
+    return publish_payload(&state, mainTOPIC_VIBRATION, temp_str);
+}
 
-	/* Initialise xNextWakeTime - this only needs to be done once. */
+static void prvQueueSendTask( void *pvParameters )
+{
+	( void ) pvParameters;
+    TickType_t xNextWakeTime;
 	xNextWakeTime = xTaskGetTickCount();
+    TickType_t xLastStats = xNextWakeTime;
+    bool boot_reported = false;
 
 	for( ;; )
-	{
-		/* Place this task in the blocked state until it is time to run again. */
-		vTaskDelayUntil( &xNextWakeTime, mainSENSOR_SAMPLE_FREQUENCY_MS );
+    {
+        send_heartbeat = xTaskGetTickCount();
 
-        uint32_t light_sensor_value = read_analog_pin(mainADA161_LIGHT_SENSOR_ADC_PIN);
-        printf("Light Sensor Value: %ld\n", light_sensor_value);
-		// /* Send to the queue */
-		xQueueSendToBack( lightQueue, &light_sensor_value, 0U );
-	}
-}
+        VibrationFeatures features;
+        if (xQueueReceive(vibrationQueue, &features, 0U) == pdTRUE && !publishVibration(&features))
+        {
+            /* Put back for the next pass, unless a newer window took its place */
+            xQueueSendToFront(vibrationQueue, &features, 0U);
+        }
 
-static void prvGasSensorTask( void *pvParameters )
-{
-    TickType_t xNextWakeTime;
+        /* An event leaves the queue only once the transport took it, the
+        rest wait for the next pass. */
+        RfidEvent door;
+        while (xQueuePeek(doorQueue, &door, 0U) == pdTRUE && publish_door_event(&state, &door))
+        {
+            ( void ) xQueueReceive(doorQueue, &door, 0U);
+        }
 
-	/* Remove compiler warning about unused parameter. */
-	( void ) pvParameters;
+        for (int stream = 0; stream < mainSTREAM_COUNT; stream++)
+        {
+            if (!publishAggregates(&streams[stream]))
+            {
+                break;
+            }
+            if (uxQueueMessagesWaiting(streams[stream].queue) >= streams[stream].batchSize &&
+                !publishQueue(&streams[stream]))
+            {
+                break;
+            }
+        }
 
-	/* Initialise xNextWakeTime - this only needs to be done once. */
-	xNextWakeTime = xTaskGetTickCount();
+        if (unitsCalibrationChanged)
+        {
+            unitsCalibrationChanged = false;
+            if (!storageSave(mainSTORAGE_SLOT_UNITS_CAL, UNITS_CAL_VERSION, unitsCalibration(), sizeof(UnitsCal)))
+            {
+                LOG_WARN("Failed to store the units calibration");
+            }
+        }
 
-	for( ;; )
-	{
-		/* Place this task in the blocked state until it is time to run again. */
-		vTaskDelayUntil( &xNextWakeTime, mainSENSOR_SAMPLE_FREQUENCY_MS );
+        /* Once everything is up, report how long it took and remember the
+        access point and lease for the next boot. */
+        if (!boot_reported && boot_phase_ms[mainBOOT_PUBLISH] && wifiBoundAtMs())
+        {
+            boot_reported = true;
+            publish_boot_profile(&state);
+            if (!wifiSaveCache())
+            {
+                LOG_WARN("Failed to store the Wi-Fi cache");
+            }
+        }
 
-        uint32_t gas_sensor_value = read_analog_pin(mainMQ7_GAS_SENSOR_ADC_PIN);
-        printf("Gas Sensor Value: %ld\n", gas_sensor_value);
-		/* Send to the queue */
-		xQueueSendToBack( gasQueue, &gas_sensor_value, 0U );
-	}
+#if mainMQTT_TLS
+        /* After each (re)connect, and keep the session for the next boot. */
+        TlsStats tls_stats;
+        if (tlsTakeStats(&tls_stats))
+        {
+            publish_tls_stats(&state, &tls_stats);
+            if (!tlsPersistSession())
+            {
+                LOG_WARN("Failed to store the TLS session");
+            }
+        }
+#endif
+
+        if (xTaskGetTickCount() - xLastStats >= mainSTATS_PERIOD_MS)
+        {
+            xLastStats = xTaskGetTickCount();
+            for (int stream = 0; stream < mainSTREAM_COUNT; stream++)
+            {
+                publish_stats(&state, &streams[stream]);
+                vTaskDelay( mainSEND_DELAY_MS );
+            }
+#if mainMQTT_SN
+            publish_transport_stats(&state);
+#endif
+            publish_memory_stats(&state);
+            publish_bus_stats(&state);
+        }
+
+        /* Wait for the messages */
+		vTaskDelayUntil( &xNextWakeTime, send_interval );
+    }
 }
 
-static void publishQueue(QueueHandle_t queue, char topic[])
+static void prvCalibrateImu( void )
 {
-    int num_elements = uxQueueMessagesWaiting(queue);
-    for (int idx = 0; idx < num_elements; idx++)
+    imuCalibrationRequested = false;
+    printf("Calibrating IMU, keep it still and level\n");
+    mpu9250CalibrateGyro(&mpu, mainMPU9250_CALIBRATION_LOOPS);
+    mpu9250CalibrateAccel(&mpu, mainMPU9250_CALIBRATION_LOOPS);
+
+    if (!storageSave(mainSTORAGE_SLOT_IMU_CAL, MPU9250_CAL_VERSION, mpu9250GetCalibration(&mpu), sizeof(MPU9250Cal)))
     {
-        uint32_t value;
-        xQueueReceive(queue, &value, portMAX_DELAY);
-        vTaskDelay( mainSEND_DELAY_MS );  // Small delay to deliver everything
-        publish_value(&state, topic, value);
+        printf("Failed to store IMU calibration\n");
     }
 }
 
-static void prvQueueSendTask( void *pvParameters )
+static void prvVibrationTask( void *pvParameters )
 {
+    /* Static so the window does not have to fit on the task stack. */
+    static int16_t samples[VIBRATION_FFT_SIZE];
+    VibrationFeatures features;
+    TickType_t xWindowStart;
+    TickType_t xNextSample;
+
 	( void ) pvParameters;
-    TickType_t xNextWakeTime;
-	xNextWakeTime = xTaskGetTickCount();
 
 	for( ;; )
+	{
+        if (imuCalibrationRequested)
+        {
+            prvCalibrateImu();
+        }
+
+        xWindowStart = xTaskGetTickCount();
+        vibration_heartbeat = xWindowStart;
+        xNextSample = xWindowStart;
+        for (int i = 0; i < VIBRATION_FFT_SIZE; i++)
+        {
+            vTaskDelayUntil( &xNextSample, mainVIBRATION_SAMPLE_PERIOD );
+            mpu9250ReadAccel(&mpu);
+            samples[i] = mpu.accel[mainVIBRATION_AXIS];
+        }
+
+        vibrationCompute(samples, mainVIBRATION_SAMPLE_RATE_HZ, &features);
+        /* Only the latest feature vector is of interest. */
+        xQueueOverwrite( vibrationQueue, &features );
+
+        vTaskDelayUntil( &xWindowStart, mainVIBRATION_WINDOW_PERIOD_MS );
+	}
+}
+
+/* Feeds the watchdog only while every task keeps going round its loop, a
+stalled task reboots the board. If this task stops, the watchdog does it. */
+static void prvHealthTask( void *pvParameters )
+{
+    ( void ) pvParameters;
+
+    watchdog_enable( mainWATCHDOG_TIMEOUT_MS, true );
+
+    for( ;; )
     {
-        if (uxQueueMessagesWaiting(lightQueue) >= mainQUEUE_THRESHOLD)
+        TickType_t now = xTaskGetTickCount();
+        if (now - samplerHeartbeat() > mainHEALTH_SAMPLER_TIMEOUT_MS)
+        {
+            prvReboot(mainREBOOT_SAMPLER_STALLED);
+        }
+        if (now - send_heartbeat > send_interval + mainHEALTH_SEND_SLACK_MS)
         {
-            publishQueue(lightQueue, "/ADA161/light");
-            xQueueReset(lightQueue);
+            prvReboot(mainREBOOT_SEND_STALLED);
         }
-        else if (uxQueueMessagesWaiting(gasQueue) >= mainQUEUE_THRESHOLD)
+        if (mpuReady && now - vibration_heartbeat > mainHEALTH_VIBRATION_TIMEOUT_MS)
         {
-            publishQueue(gasQueue, "/MQ-7/gas");
-            xQueueReset(gasQueue);
+            prvReboot(mainREBOOT_VIBRATION_STALLED);
         }
 
-        /* Wait for the messages */
-		vTaskDelayUntil( &xNextWakeTime, mainQUEUE_SEND_FREQUENCY_MS );
+        watchdog_update();
+        vTaskDelay( mainHEALTH_PERIOD_MS );
     }
 }
 
@@ -363,6 +1364,26 @@ static void prvSetupHardware( void )
     stdio_init_all();
     adc_init();
 
+    /* After a watchdog reset the sensors are already warm and the retained
+    samples are waiting, so the start up delay is skipped. */
+    warm_boot = watchdog_caused_reboot();
+    uint32_t reboot_reason = mainREBOOT_NONE;
+    if (warm_boot)
+    {
+        uint32_t reason = watchdog_hw->scratch[ mainREBOOT_SCRATCH ];
+        bool requested = (reason & 0xFFFF0000) == mainREBOOT_MAGIC;
+        if (requested)
+        {
+            reboot_reason = reason & 0xFFFF;
+        }
+        printf("Watchdog reboot, reason %lu\n", reboot_reason);
+        /* Watchdog timeouts, picotool and debugger resets leave no reason */
+        still_unlocked = requested &&
+                         watchdog_hw->scratch[ mainUNLOCK_SCRATCH ] == mainUNLOCK_MAGIC;
+    }
+    watchdog_hw->scratch[ mainREBOOT_SCRATCH ] = 0;
+    watchdog_hw->scratch[ mainUNLOCK_SCRATCH ] = 0;
+
     // if (cyw43_arch_init_with_country(CYW43_COUNTRY_SLOVENIA))
     if (cyw43_arch_init())
     {
@@ -373,19 +1394,90 @@ static void prvSetupHardware( void )
     // On board LED is ON
     cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
 
+    // Enable wifi station and start joining, it completes while the
+    // sensors are set up and warm up. A first connect that failed may have
+    // been down to the cached access point or lease, so they are not trusted
+    // again until a fresh join has published.
+    cyw43_arch_enable_sta_mode();
+    wifiStart(mainWIFI_SSID, mainWIFI_PASSWORD, mainSTORAGE_SLOT_WIFI,
+              reboot_reason != mainREBOOT_MQTT_CONNECT);
+
     // ADA161 Light sensor on ADC0
     adc_gpio_init(mainADA161_LIGHT_SENSOR_PIN); // Enable ADC on GPIO26
 
     // MQ-7 Gas sensor on ADC1
-    adc_gpio_init(mainADA161_LIGHT_SENSOR_PIN); // Enable ADC on GPIO27
+    adc_gpio_init(mainMQ7_GAS_SENSOR_PIN); // Enable ADC on GPIO27
 
-    mfrc = MFRC522_Init();
-    PCD_Init(mfrc, spi0);
+    // MQ-7 heater cycling, gas readings are only taken in its low phase
+    if (!mq7Start(mainMQ7_HEATER_PIN, mainMQ7_WINDOW_MS))
+    {
+        printf("Failed to start the MQ-7 heater\n");
+    }
 
-    sleep_ms(mainHW_INIT_DELAY_MS);
+    // Internal temperature sensor on ADC4, compensates the MQ-7
+    adc_set_temp_sensor_enabled(true);
+    UnitsCal units_cal;
+    if (storageLoad(mainSTORAGE_SLOT_UNITS_CAL, UNITS_CAL_VERSION, &units_cal, sizeof(units_cal)))
+    {
+        unitsSetCalibration(&units_cal);
+    }
 
-    // Enable wifi station
-    cyw43_arch_enable_sta_mode();
+    /* The reset line is shared, the in reader pulses it for both. */
+    const MFRC522Config_t reader_configs[mainMFRC522_READERS] = {
+        {
+            .spi = mainMFRC522_SPI_PORT, .sckPin = mainMFRC522_SCK_PIN,
+            .mosiPin = mainMFRC522_MOSI_PIN, .misoPin = mainMFRC522_MISO_PIN,
+            .csPin = mainMFRC522_IN_CS_PIN, .resetPin = mainMFRC522_RESET_PIN,
+            .baudrate = mainMFRC522_BAUDRATE,
+        },
+        {
+            .spi = mainMFRC522_SPI_PORT, .sckPin = mainMFRC522_SCK_PIN,
+            .mosiPin = mainMFRC522_MOSI_PIN, .misoPin = mainMFRC522_MISO_PIN,
+            .csPin = mainMFRC522_OUT_CS_PIN, .resetPin = MFRC522_NO_PIN,
+            .baudrate = mainMFRC522_BAUDRATE,
+        },
+    };
+    for (int i = 0; i < mainMFRC522_READERS; i++)
+    {
+        readers[i] = MFRC522_InitWithConfig(&reader_configs[i]);
+        PCD_Init(readers[i]);
+    }
+    mfrc = readers[0];
+
+    // MPU9250 IMU on SPI1
+    const MPU9250Desc mpuDesc = {
+        .pinMISO = mainMPU9250_MISO_PIN,
+        .pinMOSI = mainMPU9250_MOSI_PIN,
+        .pinSCK = mainMPU9250_SCK_PIN,
+        .pinCS = mainMPU9250_CS_PIN,
+        .spiPort = mainMPU9250_SPI_PORT,
+    };
+    mpu = mpu9250Init(&mpuDesc);
+    mpuReady = mpu9250Start(&mpu);
+    if (!mpuReady)
+    {
+        printf("Failed to initialise MPU9250\n");
+    }
+    else
+    {
+        MPU9250Cal cal;
+        if (storageLoad(mainSTORAGE_SLOT_IMU_CAL, MPU9250_CAL_VERSION, &cal, sizeof(cal)))
+        {
+            mpu9250SetCalibration(&mpu, &cal);
+        }
+        else
+        {
+            /* First boot, calibrate once the vibration task is running. */
+            imuCalibrationRequested = true;
+        }
+    }
+    vibrationInit();
+
+    if (!warm_boot)
+    {
+        sleep_ms(mainHW_INIT_DELAY_MS);
+    }
+    boot_mark(mainBOOT_HW);
 
     printf("Initialised HW.\n");
 }
@@ -9,12 +9,54 @@
 
 #define mainMQ7_GAS_SENSOR_PIN 27
 #define mainMQ7_GAS_SENSOR_ADC_PIN 1
+/* MOSFET gate switching the MQ-7 heater, see mq7.h */
+#define mainMQ7_HEATER_PIN 21
+/* End of the low heater phase in which gas readings are taken */
+#define mainMQ7_WINDOW_MS 15000
+
+#define mainMPU9250_MISO_PIN 12
+#define mainMPU9250_CS_PIN 13
+#define mainMPU9250_SCK_PIN 14
+#define mainMPU9250_MOSI_PIN 15
+#define mainMPU9250_SPI_PORT spi1
+
+/* Reads averaged for the gyro and accel biases, the IMU has to lie still
+and level meanwhile. */
+#define mainMPU9250_CALIBRATION_LOOPS 500
+
+/* Flash slots used by storage.c */
+#define mainSTORAGE_SLOT_IMU_CAL 0
+#define mainSTORAGE_SLOT_WIFI 1
+#define mainSTORAGE_SLOT_TLS 2
+#define mainSTORAGE_SLOT_UNITS_CAL 3
+
+/* Entrance readers, in and out, on one SPI bus. They share SCK, MOSI, MISO
+and the reset line and differ in chip select. */
+#define mainMFRC522_SPI_PORT spi0
+#define mainMFRC522_SCK_PIN 18
+#define mainMFRC522_MOSI_PIN 19
+#define mainMFRC522_MISO_PIN 16
+#define mainMFRC522_RESET_PIN 20
+#define mainMFRC522_IN_CS_PIN 17
+#define mainMFRC522_OUT_CS_PIN 22
+#define mainMFRC522_BAUDRATE 1000000
+#define mainMFRC522_READERS 2
+/* Card reads waiting for the send task */
+#define mainDOOR_QUEUE_LENGTH 8
 
 #define mainMFRC522_CARD_TAG_0 0x22
 #define mainMFRC522_CARD_TAG_1 0x41
 #define mainMFRC522_CARD_TAG_2 0xCC
 #define mainMFRC522_CARD_TAG_3 0x10
 
+/* Badge data read at unlock, the data blocks of sectors 1 and 2 of a MIFARE
+Classic, and the keys A tried on them: factory default, then MAD. */
+#define mainBADGE_BLOCKS { 4, 5, 6, 8, 9, 10 }
+#define mainBADGE_KEYS { \
+    { { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF } }, \
+    { { 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5 } }, \
+}
+
 //#define mainLED_PIN 
 
 // Defined in Cmake
@@ -23,8 +65,80 @@
 #define mainMQTT_SERVER "192.168.60.120"
 #define mainMQTT_PORT 1883
 
+// MQTT over TLS, set from Cmake with MQTT_TLS=1. The name has to match the
+// broker certificate, see tools/tls_certs.sh.
+#ifndef mainMQTT_TLS
+#define mainMQTT_TLS 0
+#endif
+#ifndef mainMQTT_TLS_HOSTNAME
+#define mainMQTT_TLS_HOSTNAME "fogberry-broker"
+#endif
+
+// Telemetry over MQTT-SN on UDP instead of MQTT, set from Cmake with
+// MQTT_SN=1. Commands and settings are only available over MQTT.
+#ifndef mainMQTT_SN
+#define mainMQTT_SN 0
+#endif
+#ifndef mainMQTTSN_GATEWAY
+#define mainMQTTSN_GATEWAY mainMQTT_SERVER
+#endif
+#define mainMQTTSN_PORT 1885
+// How long a publish waits for an acknowledgement to free the window
+#define mainMQTTSN_WINDOW_WAIT_MS 3000
+
+#if mainMQTT_TLS && mainMQTT_SN
+#error "MQTT_TLS and MQTT_SN cannot be combined"
+#endif
+
+// Benchmark image comparing the block pools with heap_4, set from Cmake
+// with POOL_BENCH=1. Runs instead of the application.
+#ifndef mainPOOL_BENCH
+#define mainPOOL_BENCH 0
+#endif
+
+// Benchmark image timing the acquisition paths with a cold and a warm XIP
+// cache, set from Cmake with HOT_PATH_BENCH=1. Build it with and without
+// RAM_HOT_PATH=1, which moves those paths to SRAM, see hotpath.h.
+#ifndef mainHOT_PATH_BENCH
+#define mainHOT_PATH_BENCH 0
+#endif
+
+// Stack profiling build reporting each task's high water mark, set from
+// Cmake with STACK_PROFILE=1. See stackprof.h.
+#ifndef mainSTACK_PROFILE
+#define mainSTACK_PROFILE 0
+#endif
+#define mainSTACK_PROFILE_PERIOD_MS 30000
+
+#if mainPOOL_BENCH && mainHOT_PATH_BENCH
+#error "POOL_BENCH and HOT_PATH_BENCH are separate images"
+#endif
+
+// Heap_5 over striped SRAM and the scratch banks, with the stacks of the
+// pinned tasks in their core's scratch bank. Set from Cmake with
+// MEMORY_LAYOUT=banked, see memory.h.
+#ifndef MEMORY_BANKED
+#define MEMORY_BANKED 0
+#endif
+// Each of the two bus contention passes, taken every stats period
+#define mainBUS_WINDOW_MS 250
+
+// Wait before connecting again once an established connection dropped
+#define mainMQTT_RECONNECT_MS 5000
+
+// Joining starts early in hardware setup, this bounds the wait in init_mqtt
+#define mainWIFI_CONNECT_TIMEOUT_MS 10000
+
+// Time source for sample timestamps, may be overridden from Cmake
+#ifndef mainSNTP_SERVER
+#define mainSNTP_SERVER "pool.ntp.org"
+#endif
+
 #define MQTT_TOPIC_LEN 100
 
+// Incoming command and config payloads are short decimal values
+#define MQTT_INCOMING_DATA_LEN 32
+
 // keep alive in seconds
 #define MQTT_KEEP_ALIVE_S 60
 
@@ -41,15 +155,50 @@
 #define MQTT_WILL_MSG "0"
 #define MQTT_WILL_QOS 1
 
+// topics below this are commands for the device, e.g. /<client>/cmd/recalibrate
+#define MQTT_COMMAND_TOPIC "/cmd"
+#define MQTT_RECALIBRATE_COMMAND MQTT_COMMAND_TOPIC "/recalibrate"
+
+// runtime settings, /<client>/config/<stream>/<setting> or /<client>/config/<setting>
+// with the new value as a decimal payload, see handle_config in main.c
+#define MQTT_CONFIG_TOPIC "/config"
+
 #define MQTT_DEVICE_NAME "pico"
 
 // Set to 1 to add the client name to topics, to support multiple devices using the same server
 #define MQTT_UNIQUE_TOPIC 1
 
+// Set to 1 to publish on /<client>/<id> instead of the full names below.
+// The id to name table is published retained on MQTT_ALIAS_TOPIC.
+#define MQTT_SHORT_TOPICS 0
+#define MQTT_ALIAS_TOPIC "/topics"
+
+/* Everything the device publishes, full topics are built once at connect. */
+#define mainTOPIC_TABLE(X) \
+    X(mainTOPIC_LIGHT,              "/ADA161/light") \
+    X(mainTOPIC_LIGHT_AGGREGATE,    "/ADA161/light/agg") \
+    X(mainTOPIC_LIGHT_STATS,        "/ADA161/light/stats") \
+    X(mainTOPIC_GAS,                "/MQ-7/gas") \
+    X(mainTOPIC_GAS_AGGREGATE,      "/MQ-7/gas/agg") \
+    X(mainTOPIC_GAS_STATS,          "/MQ-7/gas/stats") \
+    X(mainTOPIC_VIBRATION,          "/MPU9250/vibration") \
+    X(mainTOPIC_BOOT,               "/boot") \
+    X(mainTOPIC_TLS,                "/tls") \
+    X(mainTOPIC_TRANSPORT,          "/transport") \
+    X(mainTOPIC_MEMORY,             "/mem") \
+    X(mainTOPIC_BUS,                "/bus") \
+    X(mainTOPIC_DOOR,               "/door")
+
+#define mainTOPIC_ID(id, name) id,
+enum {
+    mainTOPIC_TABLE(mainTOPIC_ID)
+    mainTOPIC_COUNT
+};
+
 typedef struct {
     mqtt_client_t* mqtt_client_inst;
     struct mqtt_connect_client_info_t mqtt_client_info;
-    char data[MQTT_OUTPUT_RINGBUF_SIZE];
+    char data[MQTT_INCOMING_DATA_LEN];
     char topic[MQTT_TOPIC_LEN];
     uint32_t len;
     ip_addr_t mqtt_server_address;
@@ -58,10 +207,77 @@ typedef struct {
     bool stop_client;
 } MQTT_CLIENT_DATA_T;
 
+/* Rows of the sensor table in main.c */
+enum {
+    mainSTREAM_LIGHT,
+    mainSTREAM_GAS,
+    mainSTREAM_COUNT
+};
+
 /* Priorities at which the tasks are created. */
-#define mainLIGHT_SENSOR_TASK_PRIORITY		( tskIDLE_PRIORITY + 1 )
-#define	mainGAS_SENSOR_TASK_PRIORITY		( tskIDLE_PRIORITY + 1 )
+#define mainLOG_TASK_PRIORITY		        ( tskIDLE_PRIORITY )
+#define mainSAMPLER_TASK_PRIORITY		    ( tskIDLE_PRIORITY + 1 )
+#define mainRFID_TASK_PRIORITY		        ( tskIDLE_PRIORITY + 2 )
 #define	mainQUEUE_SEND_TASK_PRIORITY		( tskIDLE_PRIORITY + 2 )
+#define	mainVIBRATION_TASK_PRIORITY		    ( tskIDLE_PRIORITY + 3 )
+#define mainHEALTH_TASK_PRIORITY		    ( tskIDLE_PRIORITY + 4 )
+
+/* Stack depth in words per task entry point. The tasks are created with
+these, tools/stack_usage.py checks them against the static call graph in
+STACK_CHECK=1 builds and STACK_PROFILE=1 builds report what each one uses. */
+#define mainTASK_STACK_TABLE(X) \
+    X(mainSTACK_WORDS_LOG,          prvLogTask,             256) \
+    X(mainSTACK_WORDS_SAMPLER,      prvSamplerTask,         256) \
+    X(mainSTACK_WORDS_SEND,         prvQueueSendTask,       256) \
+    X(mainSTACK_WORDS_VIBRATION,    prvVibrationTask,       256) \
+    X(mainSTACK_WORDS_HEALTH,       prvHealthTask,          256) \
+    X(mainSTACK_WORDS_RFID,         prvRfidTask,            256) \
+    X(mainSTACK_WORDS_PROFILE,      prvStackProfileTask,    256)
+
+#define mainSTACK_ENUM(id, entry, words) id = words,
+enum {
+    mainTASK_STACK_TABLE(mainSTACK_ENUM)
+};
+
+/* The health task feeds the watchdog while every task keeps checking in. */
+#define mainWATCHDOG_TIMEOUT_MS             ( 5000 )
+#define mainHEALTH_PERIOD_MS                ( 1000 / portTICK_PERIOD_MS )
+#define mainHEALTH_SAMPLER_TIMEOUT_MS       ( 5000 / portTICK_PERIOD_MS )
+/* On top of the send interval, publishing a full round takes a while. */
+#define mainHEALTH_SEND_SLACK_MS            ( 30000 / portTICK_PERIOD_MS )
+#define mainHEALTH_VIBRATION_TIMEOUT_MS     ( 3 * mainVIBRATION_WINDOW_PERIOD_MS )
+#define mainREBOOT_DELAY_MS                 ( 10 )
+
+/* Why the firmware rebooted itself, kept in a watchdog scratch register. */
+#define mainREBOOT_SCRATCH                  ( 0 )
+#define mainREBOOT_MAGIC                    ( 0xB0070000 )
+/* Set once a card unlocked the device, survives only the firmware's own
+reboots through prvReboot. */
+#define mainUNLOCK_SCRATCH                  ( 1 )
+#define mainUNLOCK_MAGIC                    ( 0x0C4DA11D )
+enum {
+    mainREBOOT_NONE,
+    mainREBOOT_MQTT_CONNECT,
+    mainREBOOT_MQTT_STATUS,
+    mainREBOOT_MQTT_CLIENT,
+    mainREBOOT_MQTT_BROKER,
+    mainREBOOT_TOPICS,
+    mainREBOOT_PUBLISH,
+    mainREBOOT_SAMPLER_STALLED,
+    mainREBOOT_SEND_STALLED,
+    mainREBOOT_VIBRATION_STALLED,
+    mainREBOOT_TLS_CONFIG,
+    mainREBOOT_MQTTSN_START,
+};
+
+/* Vibration analysis runs on its own core so sampling is not disturbed by wifi. */
+#define mainVIBRATION_CORE                  ( 1 )
+#define mainVIBRATION_SAMPLE_RATE_HZ        ( 1000 )
+#define mainVIBRATION_SAMPLE_PERIOD         ( configTICK_RATE_HZ / mainVIBRATION_SAMPLE_RATE_HZ )
+/* One window is captured and reduced to features per period. */
+#define mainVIBRATION_WINDOW_PERIOD_MS      ( 10000 / portTICK_PERIOD_MS )
+/* Accelerometer axis that is analysed (0 = X, 1 = Y, 2 = Z). */
+#define mainVIBRATION_AXIS                  ( 2 )
 
 #define mainSENSOR_SAMPLE_FREQUENCY_MS	    ( 2000 / portTICK_PERIOD_MS )
 #define mainQUEUE_SEND_FREQUENCY_MS	        ( 3000 / portTICK_PERIOD_MS )
@@ -69,7 +285,43 @@ typedef struct {
 
 /* The number of items the queue can hold. */
 #define mainQUEUE_LENGTH					( 10 )
-/* When is the queue send. */
+/* When is the queue send, default per stream batch size. */
 #define mainQUEUE_THRESHOLD                 ( 3 )
 
+/* Adaptive sampling, the period moves between these as the signal changes. */
+#define mainADAPTIVE_MIN_PERIOD_MS          ( 250 )
+#define mainADAPTIVE_MAX_PERIOD_MS          ( 10000 )
+/* Steady samples before the period is stretched. */
+#define mainADAPTIVE_CALM_SAMPLES           ( 8 )
+/* Change that counts as the signal moving, in lux and ppm. */
+#define mainADAPTIVE_LIGHT_THRESHOLD        ( 10 )
+#define mainADAPTIVE_GAS_THRESHOLD          ( 10 )
+/* Combined samples per minute the adaptive streams may use. */
+#define mainSAMPLE_BUDGET_PER_MIN           ( 240 )
+
+/* Report by exception for the light sensor, which sits flat most of the night. */
+#define mainLIGHT_DEADBAND                  ( 3 )
+#define mainLIGHT_HEARTBEAT_MS              ( 60000 / portTICK_PERIOD_MS )
+
+/* The gas sensor only reports min/max/mean style windows, its spikes
+still show up in the max. One window per heater cycle, sampled at least
+four times. */
+#define mainGAS_AGGREGATE_WINDOW_MS         ( mainMQ7_WINDOW_MS / portTICK_PERIOD_MS )
+#define mainGAS_MAX_PERIOD_MS               ( mainMQ7_WINDOW_MS / 4 )
+
+/* Boot phases timed by main.c, Wi-Fi join and DHCP are timed by wifi.c. */
+enum {
+    mainBOOT_HW,
+    mainBOOT_CONNACK,
+    mainBOOT_PUBLISH,
+    mainBOOT_PHASE_COUNT
+};
+
+/* How often sequence and drop counters are published per stream */
+#define mainSTATS_PERIOD_MS                 ( 60000 / portTICK_PERIOD_MS )
+
+/* Limits for values received over MQTT_CONFIG_TOPIC. */
+#define mainCONFIG_MIN_PERIOD_MS            ( 10 )
+#define mainCONFIG_MAX_PERIOD_MS            ( 3600000 )
+
 #endif /* MAIN_H */
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef MBEDTLS_CONFIG_FOGBERRY_H
+#define MBEDTLS_CONFIG_FOGBERRY_H
+
+// Only used with MQTT_TLS, see CMakeLists.txt. A TLS 1.2 client with
+// ECDHE-ECDSA and AES-GCM, which is what tools/tls_certs.sh sets up.
+
+// Some mbedTLS sources use INT_MAX without including it
+#include <limits.h>
+
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+#define MBEDTLS_NO_PLATFORM_ENTROPY
+#define MBEDTLS_ENTROPY_HARDWARE_ALT
+// Ticket lifetimes are checked against time(), pico_mbedtls has the ms clock
+#define MBEDTLS_HAVE_TIME
+#define MBEDTLS_PLATFORM_MS_TIME_ALT
+
+// Record buffers are 16 KiB each by default. Publishes are small and the
+// self-signed chain fits in 4 KiB, which saves about 26 KiB of heap.
+#define MBEDTLS_SSL_IN_CONTENT_LEN      4096
+#define MBEDTLS_SSL_OUT_CONTENT_LEN     2048
+
+// Resumption, by session id and by ticket
+#define MBEDTLS_SSL_SESSION_TICKETS
+#define MBEDTLS_SSL_SERVER_NAME_INDICATION
+
+#define MBEDTLS_SSL_PROTO_TLS1_2
+#define MBEDTLS_SSL_CLI_C
+#define MBEDTLS_SSL_TLS_C
+#define MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED
+#define MBEDTLS_ECP_DP_SECP256R1_ENABLED
+#define MBEDTLS_ECP_NIST_OPTIM
+#define MBEDTLS_ECDH_C
+#define MBEDTLS_ECDSA_C
+#define MBEDTLS_ECP_C
+#define MBEDTLS_BIGNUM_C
+
+#define MBEDTLS_AES_C
+#define MBEDTLS_AES_FEWER_TABLES
+#define MBEDTLS_GCM_C
+#define MBEDTLS_CIPHER_C
+#define MBEDTLS_MD_C
+#define MBEDTLS_SHA224_C
+#define MBEDTLS_SHA256_C
+#define MBEDTLS_SHA256_SMALLER
+#define MBEDTLS_CTR_DRBG_C
+#define MBEDTLS_ENTROPY_C
+
+#define MBEDTLS_X509_USE_C
+#define MBEDTLS_X509_CRT_PARSE_C
+#define MBEDTLS_PK_C
+#define MBEDTLS_PK_PARSE_C
+#define MBEDTLS_PEM_PARSE_C
+#define MBEDTLS_BASE64_C
+#define MBEDTLS_ASN1_PARSE_C
+#define MBEDTLS_ASN1_WRITE_C
+#define MBEDTLS_OID_C
+#define MBEDTLS_PLATFORM_C
+#define MBEDTLS_ERROR_C
+
+#endif //MBEDTLS_CONFIG_FOGBERRY_H
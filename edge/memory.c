@@ -0,0 +1,111 @@
+#include "memory.h"
+
+#include <pico/stdlib.h>
+#include <hardware/structs/busctrl.h>
+
+#include "task.h"
+
+#if defined(MEMORY_BANKED) && MEMORY_BANKED
+
+// From the SDK linker script: end of what is linked into each scratch bank
+// and bottom of the interrupt stack at its top
+extern uint8_t __scratch_x_end__[];
+extern uint8_t __scratch_y_end__[];
+extern uint8_t __StackOneBottom[];
+extern uint8_t __StackBottom[];
+
+// heap_5 does not use anything smaller than its block header and alignment
+#define MEMORY_MIN_REGION 64
+
+// The striped part of the heap, configTOTAL_HEAP_SIZE as with heap_4
+static uint8_t stripedHeap[configTOTAL_HEAP_SIZE] __attribute__((aligned(8)));
+
+typedef struct CoreStacks {
+    StackType_t *next;
+    StackType_t *end;
+} CoreStacks;
+
+static CoreStacks stacks[2];
+
+static inline uint8_t *alignUp(uint8_t *p) {
+    return (uint8_t *) (((uintptr_t) p + 7u) & ~(uintptr_t) 7u);
+}
+
+// Carves `words` of stack from the bottom of a scratch bank, returns where
+// the heap part of the bank starts. No stacks when they do not fit.
+static uint8_t *reserveStacks(CoreStacks *core, uint8_t *start, uint8_t *end, uint32_t words) {
+    start = alignUp(start);
+    if (words * sizeof(StackType_t) > (size_t) (end - start)) {
+        return start;
+    }
+    core->next = (StackType_t *) start;
+    core->end = core->next + words;
+    return (uint8_t *) core->end;
+}
+
+bool memoryInit(uint32_t core0StackWords, uint32_t core1StackWords) {
+    uint8_t *xHeap = reserveStacks(&stacks[1], __scratch_x_end__, __StackOneBottom, core1StackWords);
+    uint8_t *yHeap = reserveStacks(&stacks[0], __scratch_y_end__, __StackBottom, core0StackWords);
+
+    // heap_5 wants the regions in address order: striped, X, Y
+    static HeapRegion_t regions[4];
+    size_t count = 0;
+    regions[count++] = (HeapRegion_t) { stripedHeap, sizeof(stripedHeap) };
+    if (__StackOneBottom - xHeap >= MEMORY_MIN_REGION) {
+        regions[count++] = (HeapRegion_t) { xHeap, (size_t) (__StackOneBottom - xHeap) };
+    }
+    if (__StackBottom - yHeap >= MEMORY_MIN_REGION) {
+        regions[count++] = (HeapRegion_t) { yHeap, (size_t) (__StackBottom - yHeap) };
+    }
+    regions[count] = (HeapRegion_t) { NULL, 0 };
+    vPortDefineHeapRegions(regions);
+    return (stacks[0].next || !core0StackWords) && (stacks[1].next || !core1StackWords);
+}
+
+StackType_t *memoryCoreStack(uint8_t core, uint32_t words) {
+    if (core > 1) {
+        return NULL;
+    }
+    CoreStacks *bank = &stacks[core];
+    if (!bank->next || (uint32_t) (bank->end - bank->next) < words) {
+        return NULL;
+    }
+    StackType_t *stack = bank->next;
+    bank->next += words;
+    return stack;
+}
+
+#endif
+
+// Contested events for SRAM0..5
+static const bus_ctrl_perf_counter_t contested[MEMORY_SRAM_BANKS] = {
+    arbiter_sram0_perf_event_access_contested,
+    arbiter_sram1_perf_event_access_contested,
+    arbiter_sram2_perf_event_access_contested,
+    arbiter_sram3_perf_event_access_contested,
+    arbiter_sram4_perf_event_access_contested,
+    arbiter_sram5_perf_event_access_contested,
+};
+
+#define MEMORY_COUNTERS (sizeof(busctrl_hw->counter) / sizeof(busctrl_hw->counter[0]))
+
+void memoryContention(uint32_t windowMs, uint32_t perSecond[MEMORY_SRAM_BANKS]) {
+    if (windowMs == 0) {
+        windowMs = 1;
+    }
+    for (size_t first = 0; first < MEMORY_SRAM_BANKS; first += MEMORY_COUNTERS) {
+        size_t n = MEMORY_SRAM_BANKS - first;
+        if (n > MEMORY_COUNTERS) {
+            n = MEMORY_COUNTERS;
+        }
+        // Writing the value clears it, the counters saturate rather than wrap
+        for (size_t i = 0; i < n; i++) {
+            busctrl_hw->counter[i].sel = contested[first + i];
+            busctrl_hw->counter[i].value = 0;
+        }
+        vTaskDelay(pdMS_TO_TICKS(windowMs));
+        for (size_t i = 0; i < n; i++) {
+            perSecond[first + i] = (uint32_t) ((uint64_t) busctrl_hw->counter[i].value * 1000 / windowMs);
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+// SRAM0-3 are striped word by word over 0x20000000-0x2003FFFF, SRAM4 and
+// SRAM5 are the 4 KiB scratch banks X and Y. The SDK puts the core 1 and
+// core 0 interrupt stacks at the top of X and Y.
+#define MEMORY_SRAM_BANKS 6
+
+#if defined(MEMORY_BANKED) && MEMORY_BANKED
+// Banked layout, MEMORY_LAYOUT=banked in Cmake. Reserves task stacks of
+// the given sizes at the bottom of each core's scratch bank (Y for core 0,
+// X for core 1) and hands heap_5 the striped heap plus whatever is left of
+// both scratch banks. Call before anything allocates. The heap is set up
+// either way, false if the stacks of a core did not fit in its bank.
+bool memoryInit(uint32_t core0StackWords, uint32_t core1StackWords);
+
+// Stack for a task pinned to `core`, from what memoryInit reserved. NULL
+// once that is used up.
+StackType_t *memoryCoreStack(uint8_t core, uint32_t words);
+#endif
+
+// Counts contested accesses per SRAM bank with the bus fabric performance
+// counters, over two windows of windowMs since there are only four
+// counters. Blocks the calling task. Results are per second.
+void memoryContention(uint32_t windowMs, uint32_t perSecond[MEMORY_SRAM_BANKS]);
+
+#endif //MEMORY_H
@@ -5,6 +5,8 @@
 */
 
 #include "mfrc522.h"
+#include "hotpath.h"
+#include "spibus.h"
 
 // ADT object allocation counter
 static int MFRC_Instance_Counter = 0;
@@ -13,12 +15,24 @@ static int MFRC_Instance_Counter = 0;
  * Set up the data structures of an MFRC522 ADT object and return a pointer
  */
 MFRC522Ptr_t MFRC522_Init() {
+	const MFRC522Config_t defaultConfig = MFRC522_DEFAULT_CONFIG;
+	return MFRC522_InitWithConfig(&defaultConfig);
+}
+
+/**
+ * Set up the data structures of a reader wired as in config
+ */
+MFRC522Ptr_t MFRC522_InitWithConfig(const MFRC522Config_t *config) {
 	// allocate instance struct array
 	static struct MFRC522_T mfrc_Instances[MFRC_MAX_INSTANCES];
 	//      static Chip_SSP_DATA_SETUP_T dataSetup_Instances[MFRC_MAX_INSTANCES];
 	//		struct MFRC522_T mfrc_struct;
 	//		Chip_SSP_DATA_SETUP_T data_setup;
 
+	if (MFRC_Instance_Counter >= MFRC_MAX_INSTANCES) {
+		return NULL;
+	}
+
 	// initialize fields
 	uint16_t i;
 	for (i = 0; i < BUFFER_SIZE; i++) {
@@ -26,7 +40,9 @@ MFRC522Ptr_t MFRC522_Init() {
 		mfrc_Instances[MFRC_Instance_Counter].Tx_Buf[i] = 0;
 	}
 
-	mfrc_Instances[MFRC_Instance_Counter]._chipSelectPin = cs_pin;
+	mfrc_Instances[MFRC_Instance_Counter].config = *config;
+	mfrc_Instances[MFRC_Instance_Counter].spi = config->spi;
+	mfrc_Instances[MFRC_Instance_Counter]._chipSelectPin = config->csPin;
 
 	// update instance counter
 	MFRC_Instance_Counter++;
@@ -44,13 +60,13 @@ MFRC522Ptr_t MFRC522_Init() {
  * Writes a uint8_t to the specified register in the MFRC522 chip.
  * The interface is described in the datasheet section 8.1.2.
  */
-void PCD_WriteRegister(MFRC522Ptr_t mfrc, uint8_t reg, uint8_t value) {
+void HOT_PATH(PCD_WriteRegister)(MFRC522Ptr_t mfrc, uint8_t reg, uint8_t value) {
 	uint8_t msg[2];
 	msg[0] = 0x00 | reg;
 	msg[1] = value;
 
 	cs_select(mfrc->_chipSelectPin);
-	spi_write_blocking(mfrc->spi, msg, 2);
+	spiBusWrite(mfrc->spi, msg, 2);
 	cs_deselect(mfrc->_chipSelectPin);
 }
 
@@ -58,7 +74,7 @@ void PCD_WriteRegister(MFRC522Ptr_t mfrc, uint8_t reg, uint8_t value) {
  * Writes a number of uint8_ts to the specified register in the MFRC522 chip.
  * The interface is described in the datasheet section 8.1.2.
  */
-void PCD_WriteNRegister(
+void HOT_PATH(PCD_WriteNRegister)(
 	MFRC522Ptr_t mfrc,
 	uint8_t reg,   ///< The register to write to. One of the PCD_Register enums.
 	uint8_t count, ///< The number of uint8_ts to write to the register
@@ -73,7 +89,7 @@ void PCD_WriteNRegister(
 	}
 
 	cs_select(mfrc->_chipSelectPin);
-	spi_write_blocking(mfrc->spi, msg, count + 1);
+	spiBusWrite(mfrc->spi, msg, count + 1);
 	cs_deselect(mfrc->_chipSelectPin);
 }
 
@@ -81,7 +97,7 @@ void PCD_WriteNRegister(
  * Reads a uint8_t from the specified register in the MFRC522 chip.
  * The interface is described in the datasheet section 8.1.2.
  */
-uint8_t PCD_ReadRegister(
+uint8_t HOT_PATH(PCD_ReadRegister)(
 	MFRC522Ptr_t mfrc, 
 	uint8_t reg ///< The register to read from. One of the PCD_Register enums
 	) {
@@ -89,8 +105,8 @@ uint8_t PCD_ReadRegister(
 	const uint8_t msg = 0x80 | reg;
 	
 	cs_select(mfrc->_chipSelectPin);
-	spi_write_blocking(mfrc->spi, &msg, 1);
-	spi_read_blocking(mfrc->spi, 0, &buf, 1);
+	spiBusWrite(mfrc->spi, &msg, 1);
+	spiBusRead(mfrc->spi, 0, &buf, 1);
 	cs_deselect(mfrc->_chipSelectPin);
 	return buf;
 }
@@ -99,33 +115,38 @@ uint8_t PCD_ReadRegister(
  * Reads a number of uint8_ts from the specified register in the MFRC522 chip.
  * The interface is described in the datasheet section 8.1.2.
  */
-void PCD_ReadNRegister(
+void HOT_PATH(PCD_ReadNRegister)(
 	MFRC522Ptr_t mfrc,
 	uint8_t reg, ///< The register to read from. One of the PCD_Register enums.
 	uint8_t count,   ///< The number of uint8_ts to read
 	uint8_t *values, ///< uint8_t array to store the values in.
 	uint8_t rxAlign ///< Only bit positions rxAlign..7 in values[0] are updated.
 	) {
-	uint8_t buf = 0;
-	const uint8_t msg = 0x80 | reg;
-	
-	cs_select(mfrc->_chipSelectPin);
-
-	// uint8_t i;
-	// for(i = 0; i < count; i++) {
-	// 	uint8_t value = 0;
-	// 	spi_write_blocking(mfrc->spi, &msg, 1);
-	// 	spi_read_blocking(mfrc->spi, 0, &value, 1);
-	// 	values[i] = value;
-	// }
-
-	uint8_t i;
-	for(i = 0; i < count; i++) {
-		values[i] = PCD_ReadRegister(mfrc, msg);
+	if (count == 0) {
+		return;
 	}
+	// One burst under a single chip select: every byte clocked out is the
+	// address again, each clocks in the register value for the previous one.
+	// The last byte out is 0 to end the read (datasheet section 8.1.2.1).
+	const uint8_t address = 0x80 | reg;
+	const uint8_t stop = 0;
+	uint8_t first = 0;
 
+	cs_select(mfrc->_chipSelectPin);
+	spiBusWrite(mfrc->spi, &address, 1);
+	for (uint8_t i = 0; i < count; i++) {
+		uint8_t *in = (i == 0 && rxAlign) ? &first : &values[i];
+		spiBusWriteRead(mfrc->spi, i + 1 < count ? &address : &stop,
+								in, 1);
+	}
 	cs_deselect(mfrc->_chipSelectPin);
-}
+
+	if (rxAlign) {
+		// Only update bit positions rxAlign..7 in values[0]
+		const uint8_t mask = (0xFF << rxAlign) & 0xFF;
+		values[0] = (values[0] & ~mask) | (first & mask);
+	}
+} // End PCD_ReadNRegister()
 
 /**
  * Sets the bits given in mask in register reg.
@@ -210,25 +231,30 @@ PCD_CalculateCRC(MFRC522Ptr_t mfrc,
 /**
  * Initializes the MFRC522 chip.
  */
-void PCD_Init(MFRC522Ptr_t mfrc, spi_inst_t *spi) {
+void PCD_Init(MFRC522Ptr_t mfrc) {
+	const MFRC522Config_t *config = &mfrc->config;
 
-	mfrc->spi = spi0;
-	gpio_put(RESET_PIN, 0);
-    sleep_ms(1000);
-    gpio_put(RESET_PIN, 1);
-	sleep_ms(50);
+	// A shared reset line was already pulsed for the reader set up first
+	if (config->resetPin != MFRC522_NO_PIN) {
+		gpio_init(config->resetPin);
+		gpio_set_dir(config->resetPin, GPIO_OUT);
+		gpio_put(config->resetPin, 0);
+		sleep_ms(1000);
+		gpio_put(config->resetPin, 1);
+		sleep_ms(50);
+	}
 
-    gpio_init(cs_pin);
-    gpio_set_dir(cs_pin, GPIO_OUT);
-    gpio_put(cs_pin, 1);
+    gpio_init(config->csPin);
+    gpio_set_dir(config->csPin, GPIO_OUT);
+    gpio_put(config->csPin, 1);
 
-    spi_init(spi0, 1000000);
+    spi_init(config->spi, config->baudrate);
 
-    spi_set_format(spi0, 8, 0, 0, SPI_MSB_FIRST);
+    spi_set_format(config->spi, 8, 0, 0, SPI_MSB_FIRST);
 
-    gpio_set_function(sck_pin, GPIO_FUNC_SPI);
-    gpio_set_function(mosi_pin, GPIO_FUNC_SPI);
-    gpio_set_function(miso_pin, GPIO_FUNC_SPI);
+    gpio_set_function(config->sckPin, GPIO_FUNC_SPI);
+    gpio_set_function(config->mosiPin, GPIO_FUNC_SPI);
+    gpio_set_function(config->misoPin, GPIO_FUNC_SPI);
 
 	PCD_WriteRegister(mfrc, CommandReg, PCD_SoftReset);
 
@@ -262,6 +288,17 @@ void PCD_Init(MFRC522Ptr_t mfrc, spi_inst_t *spi) {
 						 // were disabled by the reset)
 } // End PCD_Init()
 
+/**
+ * Checks the version register for a known chip, without one every register
+ * reads as the idle level of MISO.
+ */
+bool PCD_IsPresent(MFRC522Ptr_t mfrc) {
+	const uint8_t version = PCD_ReadRegister(mfrc, VersionReg);
+	// Clones, v0.0, v1.0, v2.0 and the FM17522
+	return version == 0x12 || version == 0x88 || version == 0x90 ||
+		   version == 0x91 || version == 0x92 || version == 0xB2;
+} // End PCD_IsPresent()
+
 /**
  * Performs a soft reset on the MFRC522 chip and waits for it to be ready again.
  */
@@ -1412,6 +1449,230 @@ StatusCode PCD_NTAG216_AUTH(MFRC522Ptr_t mfrc, uint8_t *passWord,
 	return STATUS_OK;
 } // End PCD_NTAG216_AUTH()
 
+/**
+ * Sector of a MIFARE Classic block, 0..39. Sectors 0-31 have 4 blocks,
+ * sectors 32-39 of the 4K have 16.
+ */
+static uint8_t MIFARE_SectorOf(uint8_t blockAddr) {
+	return blockAddr < 128 ? blockAddr / 4 : 32 + (blockAddr - 128) / 16;
+}
+
+/**
+ * Address of the sector trailer, the block authentication is done against.
+ */
+static uint8_t MIFARE_TrailerOf(uint8_t sector) {
+	return sector < 32 ? sector * 4 + 3 : 128 + (sector - 32) * 16 + 15;
+}
+
+/**
+ * CRC_A of ISO/IEC 14443-3 computed on the host. The CRC coprocessor in
+ * PCD_CalculateCRC() costs a FIFO load and register polls over SPI each time.
+ */
+static void MIFARE_CRC_A(const uint8_t *data, uint8_t length, uint8_t *result) {
+	uint16_t crc = 0x6363;
+	for (uint8_t i = 0; i < length; i++) {
+		uint8_t ch = data[i] ^ (uint8_t)crc;
+		ch ^= (uint8_t)(ch << 4);
+		crc = (crc >> 8) ^ ((uint16_t)ch << 8) ^ ((uint16_t)ch << 3) ^
+			  (ch >> 4);
+	}
+	result[0] = crc & 0xFF;
+	result[1] = crc >> 8;
+}
+
+/**
+ * A failed authentication leaves the PICC in state IDLE. Wakes it up and
+ * selects it again by its UID, so the next key can be tried.
+ */
+static StatusCode MIFARE_Reselect(MFRC522Ptr_t mfrc, Uid *uid) {
+	uint8_t atqa[2];
+	uint8_t atqaSize = sizeof(atqa);
+	PCD_StopCrypto1(mfrc);
+	StatusCode status = PICC_WakeupA(mfrc, atqa, &atqaSize);
+	if (status != STATUS_OK) {
+		return status;
+	}
+	Uid again = *uid;
+	return PICC_Select(mfrc, &again, uid->size * 8);
+}
+
+/**
+ * Authenticates a sector with key A, trying the key that opened it last time
+ * first and then the others in order. Remembers the one that worked.
+ */
+static StatusCode MIFARE_AuthenticateSector(MFRC522Ptr_t mfrc, Uid *uid,
+											uint8_t sector,
+											const MIFARE_Key *keys,
+											uint8_t keyCount,
+											MIFARE_ReadStats_t *stats) {
+	const uint32_t start = time_us_32();
+	const uint8_t cached = mfrc->keyCache[sector];
+	const uint8_t first = (cached && cached <= keyCount) ? cached - 1 : 0;
+	StatusCode status = STATUS_INVALID;
+
+	for (uint8_t attempt = 0; attempt < keyCount; attempt++) {
+		const uint8_t k =
+			attempt == 0 ? first : (attempt <= first ? attempt - 1 : attempt);
+		if (attempt > 0) {
+			stats->keyRetries++;
+			status = MIFARE_Reselect(mfrc, uid);
+			if (status != STATUS_OK) {
+				break;
+			}
+		}
+		status = PCD_Authenticate(mfrc, PICC_CMD_MF_AUTH_KEY_A,
+								  MIFARE_TrailerOf(sector),
+								  (MIFARE_Key *)&keys[k], uid);
+		if (status == STATUS_OK) {
+			mfrc->keyCache[sector] = k + 1;
+			stats->auths++;
+			break;
+		}
+	}
+	if (status != STATUS_OK) {
+		mfrc->keyCache[sector] = 0;
+	}
+	stats->authUs += time_us_32() - start;
+	return status;
+}
+
+/**
+ * MIFARE_Read() without the CRC coprocessor, for the command or the reply.
+ * The reply comes out of the FIFO in one SPI burst.
+ */
+static StatusCode MIFARE_ReadBlock(MFRC522Ptr_t mfrc, uint8_t blockAddr,
+								   uint8_t *out) {
+	uint8_t buffer[18];
+	uint8_t size = sizeof(buffer);
+	uint8_t validBits = 0;
+	uint8_t crc[2];
+
+	buffer[0] = PICC_CMD_MF_READ;
+	buffer[1] = blockAddr;
+	MIFARE_CRC_A(buffer, 2, &buffer[2]);
+	StatusCode status = PCD_TransceiveData(mfrc, buffer, 4, buffer, &size,
+										   &validBits, 0, false);
+	if (status != STATUS_OK) {
+		return status;
+	}
+	if (size == 1 && validBits == 4) {
+		return STATUS_MIFARE_NACK;
+	}
+	if (size != sizeof(buffer) || validBits != 0) {
+		return STATUS_CRC_WRONG;
+	}
+	MIFARE_CRC_A(buffer, 16, crc);
+	if (buffer[16] != crc[0] || buffer[17] != crc[1]) {
+		return STATUS_CRC_WRONG;
+	}
+	memcpy(out, buffer, 16);
+	return STATUS_OK;
+}
+
+/**
+ * Reads a list of blocks from a MIFARE Classic PICC. Each sector is
+ * authenticated once and all of its blocks in the list are read back to
+ * back after it, in the order they first appear. Keys A are tried per
+ * sector starting with the one that opened it on the previous card, see
+ * keyCache.
+ *
+ * The PICC must be selected. It is left authenticated: call PICC_HaltA()
+ * and PCD_StopCrypto1() when done, as after PCD_Authenticate().
+ *
+ * @return STATUS_OK when every block was read, otherwise the first error.
+ * Blocks read before it are in buffer.
+ */
+StatusCode MIFARE_ReadBlocks(
+	MFRC522Ptr_t mfrc,
+	Uid *uid,				///< Pointer to Uid struct returned from a
+							///successful PICC_Select().
+	const uint8_t *blocks,	///< Block addresses to read.
+	uint8_t count,			///< Number of blocks.
+	const MIFARE_Key *keys, ///< Key A candidates.
+	uint8_t keyCount,		///< Number of keys.
+	uint8_t *buffer,		///< 16 uint8_ts per block, in the order of blocks.
+	MIFARE_ReadStats_t *stats ///< NULL or where the timing goes.
+	) {
+	MIFARE_ReadStats_t unused;
+	if (stats == NULL) {
+		stats = &unused;
+	}
+	memset(stats, 0, sizeof(*stats));
+	if (blocks == NULL || buffer == NULL || keys == NULL || keyCount == 0) {
+		return STATUS_INVALID;
+	}
+
+	const uint32_t start = time_us_32();
+	StatusCode status = STATUS_OK;
+	for (uint8_t i = 0; i < count && status == STATUS_OK; i++) {
+		const uint8_t sector = MIFARE_SectorOf(blocks[i]);
+		// Read along with an earlier block of its sector
+		bool done = false;
+		for (uint8_t j = 0; j < i && !done; j++) {
+			done = MIFARE_SectorOf(blocks[j]) == sector;
+		}
+		if (done) {
+			continue;
+		}
+
+		status = MIFARE_AuthenticateSector(mfrc, uid, sector, keys, keyCount,
+										   stats);
+		const uint32_t reading = time_us_32();
+		for (uint8_t j = i; j < count && status == STATUS_OK; j++) {
+			if (MIFARE_SectorOf(blocks[j]) == sector) {
+				status = MIFARE_ReadBlock(mfrc, blocks[j], &buffer[j * 16]);
+				if (status == STATUS_OK) {
+					stats->blocks++;
+				}
+			}
+		}
+		stats->readUs += time_us_32() - reading;
+	}
+	stats->totalUs = time_us_32() - start;
+	return status;
+} // End MIFARE_ReadBlocks()
+
+/**
+ * Same as MIFARE_ReadBlocks() the way PICC_DumpMifareClassicSectorToSerial()
+ * does it: PCD_Authenticate() and MIFARE_Read() for every block. Kept as
+ * the reference its timing is compared with.
+ */
+StatusCode MIFARE_ReadBlocksOneByOne(MFRC522Ptr_t mfrc, Uid *uid,
+									 const uint8_t *blocks, uint8_t count,
+									 const MIFARE_Key *keys, uint8_t keyCount,
+									 uint8_t *buffer,
+									 MIFARE_ReadStats_t *stats) {
+	MIFARE_ReadStats_t unused;
+	if (stats == NULL) {
+		stats = &unused;
+	}
+	memset(stats, 0, sizeof(*stats));
+	if (blocks == NULL || buffer == NULL || keys == NULL || keyCount == 0) {
+		return STATUS_INVALID;
+	}
+
+	const uint32_t start = time_us_32();
+	StatusCode status = STATUS_OK;
+	for (uint8_t i = 0; i < count && status == STATUS_OK; i++) {
+		status = MIFARE_AuthenticateSector(
+			mfrc, uid, MIFARE_SectorOf(blocks[i]), keys, keyCount, stats);
+		if (status != STATUS_OK) {
+			break;
+		}
+		const uint32_t reading = time_us_32();
+		uint8_t block[18];
+		uint8_t size = sizeof(block);
+		status = MIFARE_Read(mfrc, blocks[i], block, &size);
+		if (status == STATUS_OK) {
+			memcpy(&buffer[i * 16], block, 16);
+			stats->blocks++;
+		}
+		stats->readUs += time_us_32() - reading;
+	}
+	stats->totalUs = time_us_32() - start;
+	return status;
+} // End MIFARE_ReadBlocksOneByOne()
+
 /*******************************************************************************
 * Support functions
 *******************************************************************************/
@@ -1496,6 +1757,8 @@ const char *GetStatusCodeName(StatusCode code ///< One of theStatusCode enums.
 		return "Invalid argument.";
 	case STATUS_CRC_WRONG:
 		return "The CRC_A does not match.";
+	case STATUS_BUSY:
+		return "Still waiting for the PICC.";
 	case STATUS_MIFARE_NACK:
 		return "A MIFARE PICC responded with NAK.";
 	default:
@@ -2250,6 +2513,53 @@ bool PICC_IsNewCardPresent(MFRC522Ptr_t mfrc) {
 	return (result == STATUS_OK || result == STATUS_COLLISION);
 } // End PICC_IsNewCardPresent()
 
+/**
+ * Sends REQA and returns without waiting for the answer, which
+ * PICC_PollRequestA() picks up. Together they do what
+ * PICC_IsNewCardPresent() does, so one task can have several readers
+ * waiting on their cards at the same time.
+ */
+void PICC_StartRequestA(MFRC522Ptr_t mfrc) {
+	uint8_t command = PICC_CMD_REQA;
+
+	PCD_ClearRegisterBitMask(mfrc, CollReg, 0x80); // ValuesAfterColl=1
+	PCD_WriteRegister(mfrc, CommandReg, PCD_Idle); // Stop any active command.
+	PCD_WriteRegister(mfrc, ComIrqReg, 0x7F);	  // Clear the interrupt bits
+	PCD_SetRegisterBitMask(mfrc, FIFOLevelReg, 0x80); // Flush the FIFO
+	PCD_WriteRegister(mfrc, FIFODataReg, command);
+	PCD_WriteRegister(mfrc, BitFramingReg, 0x07); // Short frame, 7 bits
+	PCD_WriteRegister(mfrc, CommandReg, PCD_Transceive);
+	PCD_SetRegisterBitMask(mfrc, BitFramingReg, 0x80); // StartSend=1
+} // End PICC_StartRequestA()
+
+/**
+ * Checks on a REQA sent by PICC_StartRequestA().
+ *
+ * @return STATUS_BUSY while waiting, STATUS_OK or STATUS_COLLISION when a
+ * PICC answered, STATUS_TIMEOUT when none did within the 25ms of the
+ * MFRC522 timer, STATUS_ERROR on a garbled answer.
+ */
+StatusCode PICC_PollRequestA(MFRC522Ptr_t mfrc) {
+	const uint8_t irq = PCD_ReadRegister(mfrc, ComIrqReg);
+	if (!(irq & 0x30)) {	  // RxIRq IdleIRq
+		return irq & 0x01 ? STATUS_TIMEOUT : STATUS_BUSY; // TimerIRq
+	}
+
+	const uint8_t error = PCD_ReadRegister(mfrc, ErrorReg);
+	if (error & 0x13) { // BufferOvfl ParityErr ProtocolErr
+		return STATUS_ERROR;
+	}
+	if (error & 0x08) { // CollErr, more than one card answered
+		return STATUS_COLLISION;
+	}
+	// The ATQA is exactly 16 bits
+	if (PCD_ReadRegister(mfrc, FIFOLevelReg) != 2 ||
+		(PCD_ReadRegister(mfrc, ControlReg) & 0x07) != 0) {
+		return STATUS_ERROR;
+	}
+	return STATUS_OK;
+} // End PICC_PollRequestA()
+
 /**
  * Simple wrapper around PICC_Select.
  * Returns true if a UID could be read.
@@ -2264,14 +2574,14 @@ bool PICC_ReadCardSerial(MFRC522Ptr_t mfrc) {
 	return (result == STATUS_OK);
 } // End
 
-static inline void cs_select(const uint cs) {
+static inline void HOT_PATH(cs_select)(const uint cs) {
     asm volatile("nop \n nop \n nop");
-    gpio_put(cs, 0); // Active low
+    spiBusSelect(cs);
     asm volatile("nop \n nop \n nop");
 }
 
-static inline void cs_deselect(const uint cs) {
+static inline void HOT_PATH(cs_deselect)(const uint cs) {
     asm volatile("nop \n nop \n nop");
-    gpio_put(cs, 1);
+    spiBusDeselect(cs);
     asm volatile("nop \n nop \n nop");
 }
\ No newline at end of file
@@ -33,14 +33,11 @@
 #define MFRC_MAX_INSTANCES 2	 
 // Reset pin to MFRC522
 #define RESET_PIN 20
+// For a reset line that is shared with a reader set up before, or not wired
+#define MFRC522_NO_PIN 0xFF
 
 static const uint8_t FIFO_SIZE = 64; // Size of the MFRC522 FIFO
 
-static const uint cs_pin = 17;
-static const uint sck_pin = 18;
-static const uint mosi_pin = 19;
-static const uint miso_pin = 16;
-
 static const uint8_t SELF_TEST_BYTES[] = {
 	0x00, 0xEB, 0x66, 0xBA, 0x57, 0xBF, 0x23, 0x95,
 	0xD0, 0xE3, 0x0D, 0x3D, 0x27, 0x89, 0x5C, 0xDE,
@@ -278,6 +275,7 @@ typedef enum _StatusCode {
 	STATUS_INTERNAL_ERROR, // Internal error in the code. Should not happen ;-)
 	STATUS_INVALID,		   // Invalid argument.
 	STATUS_CRC_WRONG,	  // The CRC_A does not match
+	STATUS_BUSY,		   // Still waiting for the PICC, poll again
 	STATUS_MIFARE_NACK = 0xff // A MIFARE PICC responded with NAK.
 } StatusCode;
 
@@ -292,18 +290,49 @@ typedef struct {
 // A struct used for passing a MIFARE Crypto1 key
 typedef struct { uint8_t keybyte[MF_KEY_SIZE]; } MIFARE_Key;
 
+// Sectors of the largest MIFARE Classic, the 4K
+#define MIFARE_SECTORS 40
+
+// Where the time of a MIFARE_ReadBlocks() call went, in microseconds
+typedef struct {
+	uint32_t totalUs;
+	uint32_t authUs;	 // Authentication, failed keys included
+	uint32_t readUs;	 // Block reads
+	uint8_t auths;		 // Successful authentications
+	uint8_t keyRetries;	 // Keys tried that did not open their sector
+	uint8_t blocks;		 // Blocks read
+} MIFARE_ReadStats_t;
+
 // A struct used to set GPIO pins of LPCXpresso4337 
 typedef struct {
 	uint8_t port;
 	uint8_t pin;
 } io_port_t;
 
+/**
+ * Wiring of one reader. Readers on one bus share spi and the SCK, MOSI and
+ * MISO pins and differ in chip select.
+ */
+typedef struct {
+	spi_inst_t *spi;
+	uint sckPin;
+	uint mosiPin;
+	uint misoPin;
+	uint csPin;
+	uint resetPin; // MFRC522_NO_PIN when shared with an earlier reader
+	uint baudrate;
+} MFRC522Config_t;
+
 // A struct used to define a MFRC522 ADT object, useful when using more than one
 struct MFRC522_T {
 	Uid uid; // Used by PICC_ReadCardSerial().
 	// Variables used in the SSP(SPI) peripheral of the board
 	spi_inst_t *spi; // Select SSP0 or SSP1
 	uint _chipSelectPin; // = {1, 8}; // As default example use GPIO1[8]= P1_5
+	MFRC522Config_t config;
+	// Per sector, 1 + the index of the key that last opened it in
+	// MIFARE_ReadBlocks(), 0 when not known
+	uint8_t keyCache[MIFARE_SECTORS];
 	uint8_t Tx_Buf[BUFFER_SIZE];
 	uint8_t Rx_Buf[BUFFER_SIZE];
 };
@@ -311,11 +340,21 @@ struct MFRC522_T {
 // Pointer to a MFRC5222 ADT object
 typedef struct MFRC522_T *MFRC522Ptr_t;
 
+// The single reader the library was written for
+#define MFRC522_DEFAULT_CONFIG { \
+	.spi = spi0, .sckPin = 18, .mosiPin = 19, .misoPin = 16, \
+	.csPin = 17, .resetPin = RESET_PIN, .baudrate = 1000000 }
+
 /**
  * Function to setup a MFRC522 ADT object
  * @return an initialized  ADT object
  */
 MFRC522Ptr_t MFRC522_Init();
+/**
+ * Same for a reader wired as in config, which is copied.
+ * @return NULL once all MFRC_MAX_INSTANCES are in use
+ */
+MFRC522Ptr_t MFRC522_InitWithConfig(const MFRC522Config_t *config);
 
 /*******************************************************************************
 * Basic interface functions for communicating with the MFRC522
@@ -339,7 +378,8 @@ static inline void cs_deselect(const uint cs);
 /*******************************************************************************
 * Functions for manipulating the MFRC522
 *******************************************************************************/
-void PCD_Init(MFRC522Ptr_t mfrc, spi_inst_t *spi);
+void PCD_Init(MFRC522Ptr_t mfrc);
+bool PCD_IsPresent(MFRC522Ptr_t mfrc);
 void PCD_Reset(MFRC522Ptr_t mfrc);
 void PCD_AntennaOn(MFRC522Ptr_t mfrc);
 void PCD_AntennaOff(MFRC522Ptr_t mfrc);
@@ -388,6 +428,14 @@ StatusCode MIFARE_GetValue(MFRC522Ptr_t mfrc, uint8_t blockAddr, long *value);
 StatusCode MIFARE_SetValue(MFRC522Ptr_t mfrc, uint8_t blockAddr, long value);
 StatusCode PCD_NTAG216_AUTH(MFRC522Ptr_t mfrc, uint8_t *passWord,
 							uint8_t pACK[]);
+StatusCode MIFARE_ReadBlocks(MFRC522Ptr_t mfrc, Uid *uid, const uint8_t *blocks,
+							 uint8_t count, const MIFARE_Key *keys,
+							 uint8_t keyCount, uint8_t *buffer,
+							 MIFARE_ReadStats_t *stats);
+StatusCode MIFARE_ReadBlocksOneByOne(MFRC522Ptr_t mfrc, Uid *uid,
+									 const uint8_t *blocks, uint8_t count,
+									 const MIFARE_Key *keys, uint8_t keyCount,
+									 uint8_t *buffer, MIFARE_ReadStats_t *stats);
 
 /*******************************************************************************
 * Support functions
@@ -395,6 +443,7 @@ StatusCode PCD_NTAG216_AUTH(MFRC522Ptr_t mfrc, uint8_t *passWord,
 StatusCode PCD_MIFARE_Transceive(MFRC522Ptr_t mfrc, uint8_t *sendData,
 								 uint8_t sendLen, bool acceptTimeout);
 const char *GetStatusCodeName(StatusCode code);
+PICC_Type PICC_GetType(uint8_t sak);
 const char *PICC_GetTypeName(PICC_Type type);
 StatusCode MIFARE_TwoStepHelper(MFRC522Ptr_t mfrc, uint8_t command,
 								uint8_t blockAddr, long data);
@@ -423,4 +472,10 @@ bool MIFARE_UnbrickUidSector(MFRC522Ptr_t mfrc, bool logErrors);
 bool PICC_IsNewCardPresent(MFRC522Ptr_t mfrc);
 bool PICC_ReadCardSerial(MFRC522Ptr_t mfrc);
 
+/*******************************************************************************
+* Non-blocking REQA, for polling several readers from one task
+*******************************************************************************/
+void PICC_StartRequestA(MFRC522Ptr_t mfrc);
+StatusCode PICC_PollRequestA(MFRC522Ptr_t mfrc);
+
 #endif
\ No newline at end of file
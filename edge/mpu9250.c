@@ -7,9 +7,19 @@
 #include <hardware/spi.h>
 #include <pico/time.h>
 
-static inline void cs_set(const MPU9250* mpu, int state) {
+#include "hotpath.h"
+#include "spibus.h"
+
+// 1 g on the +-2 g range the accelerometer comes out of reset with
+#define MPU9250_ACCEL_1G 16384
+
+static inline void HOT_PATH(cs_set)(const MPU9250* mpu, int state) {
     __asm volatile("nop \n nop \n nop");
-    gpio_put(mpu->_desc.pinCS, state);
+    if (state) {
+        spiBusDeselect(mpu->_desc.pinCS);
+    } else {
+        spiBusSelect(mpu->_desc.pinCS);
+    }
     __asm volatile("nop \n nop \n nop");
 }
 
@@ -22,15 +32,13 @@ static inline void cs_deselect(const MPU9250* mpu) {
 }
 
 #define READ_BIT 0x80
-static inline void readRegister(const MPU9250 *mpu, uint8_t reg, uint8_t *out, uint16_t len) {
+static inline void HOT_PATH(readRegister)(const MPU9250 *mpu, uint8_t reg, uint8_t *out, uint16_t len) {
     const MPU9250Desc *desc = &mpu->_desc;
     reg |= READ_BIT;
     cs_select(mpu);
-    spi_write_blocking(desc->spiPort, &reg, 1);
-    sleep_ms(10);
-    spi_read_blocking(desc->spiPort, 0, out, len);
+    spiBusWrite(desc->spiPort, &reg, 1);
+    spiBusRead(desc->spiPort, 0, out, len);
     cs_deselect(mpu);
-    sleep_ms(10);
 }
 #undef READ_BIT
 
@@ -73,31 +81,67 @@ void mpu9250Reset(MPU9250 *mpu) {
     // Two byte reset {register, data}
     uint8_t payload[2] = {0x6B, 0x00};
     cs_set(mpu, 0);
-    spi_write_blocking(mpu->_desc.spiPort, payload, 2);
+    spiBusWrite(mpu->_desc.spiPort, payload, 2);
     cs_set(mpu, 1);
 }
 
-static inline void readI16Data(const MPU9250 *mpu, uint8_t reg, int16_t *data, int16_t len) {
+static inline void HOT_PATH(readI16Data)(const MPU9250 *mpu, uint8_t reg, int16_t *data, int16_t len) {
     const int16_t byteSize = len * 2;
     uint8_t buffer[byteSize];
     readRegister(mpu, reg, buffer, byteSize);
     for (int i = 0; i < len; i++) {
-        data[i] = (int16_t) (buffer[i * 2] << 8 | buffer[(i * 2) + i]);
+        data[i] = (int16_t) (buffer[i * 2] << 8 | buffer[(i * 2) + 1]);
     }
 }
 
 void mpu9250CalibrateGyro(MPU9250 *mpu, int16_t loop) {
     int16_t raw[3];
-    int16_t *gyroCal = mpu->_gyroCal;
+    // 32 bit sums, int16_t overflows after a handful of reads
+    int32_t sum[3] = {0, 0, 0};
     for (int i = 0; i < loop; i++) {
         readI16Data(mpu, 0x43, raw, 3);
-        gyroCal[0] += raw[0];
-        gyroCal[1] += raw[1];
-        gyroCal[2] += raw[2];
+        sum[0] += raw[0];
+        sum[1] += raw[1];
+        sum[2] += raw[2];
+    }
+    int16_t *gyroBias = mpu->_cal.gyroBias;
+    gyroBias[0] = (int16_t) (sum[0] / loop);
+    gyroBias[1] = (int16_t) (sum[1] / loop);
+    gyroBias[2] = (int16_t) (sum[2] / loop);
+}
+
+void mpu9250CalibrateAccel(MPU9250 *mpu, int16_t loop) {
+    int16_t raw[3];
+    int32_t sum[3] = {0, 0, 0};
+    for (int i = 0; i < loop; i++) {
+        readI16Data(mpu, 0x3B, raw, 3);
+        sum[0] += raw[0];
+        sum[1] += raw[1];
+        sum[2] += raw[2];
     }
-    gyroCal[0] /= loop;
-    gyroCal[1] /= loop;
-    gyroCal[2] /= loop;
+    int16_t *accelBias = mpu->_cal.accelBias;
+    accelBias[0] = (int16_t) (sum[0] / loop);
+    accelBias[1] = (int16_t) (sum[1] / loop);
+    accelBias[2] = (int16_t) (sum[2] / loop - MPU9250_ACCEL_1G);
+}
+
+void mpu9250SetCalibration(MPU9250 *mpu, const MPU9250Cal *cal) {
+    mpu->_cal = *cal;
+}
+
+const MPU9250Cal *mpu9250GetCalibration(const MPU9250 *mpu) {
+    return &mpu->_cal;
+}
+
+static inline void HOT_PATH(calibrateAccel)(const MPU9250Cal *cal, int16_t accel[3]) {
+    for (int i = 0; i < 3; i++) {
+        accel[i] = (int16_t) (accel[i] - cal->accelBias[i]);
+    }
+}
+
+void HOT_PATH(mpu9250ReadAccel)(MPU9250 *mpu) {
+    readI16Data(mpu, 0x3B, mpu->accel, 3);
+    calibrateAccel(&mpu->_cal, mpu->accel);
 }
 
 static inline void calculateAnglesFromAcc(int16_t eulerAngles[2], int16_t accel[3]) {
@@ -114,9 +158,10 @@ void mpu9250Read(MPU9250 *mpu) {
     readI16Data(mpu, 0x3B, mpu->accel, 3);
     readI16Data(mpu, 0x43, mpu->gyro, 3);
     // magnetometer
-    mpu->gyro[0] -= mpu->_gyroCal[0];
-    mpu->gyro[1] -= mpu->_gyroCal[1];
-    mpu->gyro[2] -= mpu->_gyroCal[2];
+    mpu->gyro[0] -= mpu->_cal.gyroBias[0];
+    mpu->gyro[1] -= mpu->_cal.gyroBias[1];
+    mpu->gyro[2] -= mpu->_cal.gyroBias[2];
+    calibrateAccel(&mpu->_cal, mpu->accel);
 
     // Calculate angles
     uint64_t hertz = 1000000/ absolute_time_diff_us(mpu->usSinceLastRead, get_absolute_time());
@@ -13,6 +13,15 @@ typedef struct MPU9250Desc {
     spi_inst_t *spiPort;
 } MPU9250Desc;
 
+// Bump when the layout of MPU9250Cal changes, stored records are then ignored
+#define MPU9250_CAL_VERSION 2
+
+// Zero rate and zero g offsets, both taken with the IMU lying still
+typedef struct MPU9250Cal {
+    int16_t gyroBias[3];
+    int16_t accelBias[3];
+} MPU9250Cal;
+
 typedef struct MPU9250 {
     int16_t accel[3];
     int16_t gyro[3];
@@ -21,7 +30,7 @@ typedef struct MPU9250 {
     int16_t mag[3];
 
 
-    int16_t _gyroCal[3];
+    MPU9250Cal _cal;
     int32_t usSinceLastRead;
     MPU9250Desc _desc;
 } MPU9250;
@@ -32,7 +41,13 @@ bool mpu9250Start(MPU9250 *mpu);
 void mpu9250Reset(MPU9250 *mpu);
 
 void mpu9250CalibrateGyro(MPU9250 *mpu, int16_t loop);
+// The IMU has to lie flat with Z up, which then reads 1 g
+void mpu9250CalibrateAccel(MPU9250 *mpu, int16_t loop);
+void mpu9250SetCalibration(MPU9250 *mpu, const MPU9250Cal *cal);
+const MPU9250Cal *mpu9250GetCalibration(const MPU9250 *mpu);
 
 void mpu9250Read(MPU9250 *mpu);
+// Only refreshes accel, for high rate sampling
+void mpu9250ReadAccel(MPU9250 *mpu);
 
 #endif //MPU9250_H
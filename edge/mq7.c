@@ -0,0 +1,90 @@
+#include "mq7.h"
+
+#include <pico/time.h>
+#include <hardware/gpio.h>
+#include <hardware/pwm.h>
+
+#include "hotpath.h"
+
+// 125 MHz / 125 / 1000, a 1 kHz PWM the heater's thermal mass smooths out
+#define MQ7_PWM_CLKDIV 125
+#define MQ7_PWM_WRAP 999
+// Heater power goes with V^2, so 1.4 V from 5 V is (1.4 / 5)^2 on time
+#define MQ7_SUPPLY_MV 5000
+#define MQ7_LOW_MV 1400
+#define MQ7_LEVEL_HEAT (MQ7_PWM_WRAP + 1)
+#define MQ7_LEVEL_MEASURE ((MQ7_PWM_WRAP + 1) * MQ7_LOW_MV / MQ7_SUPPLY_MV * MQ7_LOW_MV / MQ7_SUPPLY_MV)
+
+static uint heaterPin;
+static uint32_t window;
+// time_us_64() at the start of the first 5 V phase, 0 before mq7Start
+static uint64_t startUs;
+static Mq7Phase current;
+
+// Runs in the alarm IRQ at each phase change, reschedules itself relative
+// to when it was due so the phases never drift from startUs
+static int64_t phaseAlarm(alarm_id_t id, void *userData) {
+    (void) id;
+    (void) userData;
+    if (current == MQ7_PHASE_HEAT) {
+        current = MQ7_PHASE_MEASURE;
+        pwm_set_gpio_level(heaterPin, MQ7_LEVEL_MEASURE);
+        return -(int64_t) MQ7_MEASURE_MS * 1000;
+    }
+    current = MQ7_PHASE_HEAT;
+    pwm_set_gpio_level(heaterPin, MQ7_LEVEL_HEAT);
+    return -(int64_t) MQ7_HEAT_MS * 1000;
+}
+
+bool mq7Start(uint pin, uint32_t windowMs) {
+    if (windowMs == 0 || windowMs > MQ7_MEASURE_MS) {
+        return false;
+    }
+    heaterPin = pin;
+    window = windowMs;
+
+    gpio_set_function(pin, GPIO_FUNC_PWM);
+    const uint slice = pwm_gpio_to_slice_num(pin);
+    pwm_config config = pwm_get_default_config();
+    pwm_config_set_clkdiv_int(&config, MQ7_PWM_CLKDIV);
+    pwm_config_set_wrap(&config, MQ7_PWM_WRAP);
+    pwm_init(slice, &config, false);
+
+    current = MQ7_PHASE_HEAT;
+    pwm_set_gpio_level(pin, MQ7_LEVEL_HEAT);
+    const uint64_t now = time_us_64();
+    if (add_alarm_at(from_us_since_boot(now + (uint64_t) MQ7_HEAT_MS * 1000), phaseAlarm, NULL, true) <= 0) {
+        pwm_set_gpio_level(pin, 0);
+        return false;
+    }
+    pwm_set_enabled(slice, true);
+    startUs = now;
+    return true;
+}
+
+bool HOT_PATH(mq7PhaseAt)(uint64_t us, Mq7PhaseInfo *info) {
+    if (!startUs || us < startUs) {
+        return false;
+    }
+    const uint64_t elapsedMs = (us - startUs) / 1000;
+    info->cycle = (uint32_t) (elapsedMs / MQ7_CYCLE_MS);
+    const uint32_t inCycle = (uint32_t) (elapsedMs % MQ7_CYCLE_MS);
+    if (inCycle < MQ7_HEAT_MS) {
+        info->phase = MQ7_PHASE_HEAT;
+        info->offsetMs = inCycle;
+    } else {
+        info->phase = MQ7_PHASE_MEASURE;
+        info->offsetMs = inCycle - MQ7_HEAT_MS;
+    }
+    return true;
+}
+
+bool HOT_PATH(mq7InWindow)(uint64_t us) {
+    Mq7PhaseInfo info;
+    return mq7PhaseAt(us, &info) && info.phase == MQ7_PHASE_MEASURE &&
+           info.offsetMs >= MQ7_MEASURE_MS - window;
+}
+
+const char *mq7PhaseName(Mq7Phase phase) {
+    return phase == MQ7_PHASE_MEASURE ? "measure" : "heat";
+}
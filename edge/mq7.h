@@ -0,0 +1,42 @@
+#ifndef MQ7_H
+#define MQ7_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pico.h>
+
+// MQ-7 heater cycle from the datasheet: 60 s at 5 V burns the sensor
+// clean, then 90 s at 1.4 V in which it responds to CO. Only the end of the
+// 1.4 V phase reads CO, everything else is the heater settling.
+// The heater is switched by a MOSFET on a PWM pin, full on for 5 V and at
+// the duty that gives the heater the power of 1.4 V for the low phase.
+#define MQ7_HEAT_MS 60000
+#define MQ7_MEASURE_MS 90000
+#define MQ7_CYCLE_MS (MQ7_HEAT_MS + MQ7_MEASURE_MS)
+
+typedef enum Mq7Phase {
+    MQ7_PHASE_HEAT,
+    MQ7_PHASE_MEASURE,
+} Mq7Phase;
+
+typedef struct Mq7PhaseInfo {
+    uint32_t cycle;         // heater cycles since mq7Start
+    Mq7Phase phase;
+    uint32_t offsetMs;      // into the phase
+} Mq7PhaseInfo;
+
+// Starts cycling the heater on `pin`, beginning with the 5 V phase.
+// Readings count as valid in the last windowMs of each low phase.
+// The phases are switched from a hardware alarm, no task is needed.
+bool mq7Start(uint pin, uint32_t windowMs);
+
+// Where the heater was at time_us_64() `us`, false before mq7Start
+bool mq7PhaseAt(uint64_t us, Mq7PhaseInfo *info);
+
+// True when a reading taken at `us` is in the valid window
+bool mq7InWindow(uint64_t us);
+
+const char *mq7PhaseName(Mq7Phase phase);
+
+#endif //MQ7_H
@@ -0,0 +1,352 @@
+#include "mqttsn.h"
+
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/cyw43_arch.h>
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "lwip/timeouts.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "log.h"
+#include "pool.h"
+
+#define MQTTSN_TICK_MS 250
+#define MQTTSN_WAIT_POLL_MS 20
+
+#define MQTTSN_CONNECT 0x04
+#define MQTTSN_CONNACK 0x05
+#define MQTTSN_PUBLISH 0x0C
+#define MQTTSN_PUBACK 0x0D
+#define MQTTSN_PINGREQ 0x16
+#define MQTTSN_PINGRESP 0x17
+#define MQTTSN_DISCONNECT 0x18
+
+#define MQTTSN_FLAG_DUP 0x80
+#define MQTTSN_FLAG_QOS1 0x20
+#define MQTTSN_FLAG_CLEAN_SESSION 0x04
+#define MQTTSN_TOPIC_PREDEFINED 0x01
+#define MQTTSN_PROTOCOL_ID 0x01
+#define MQTTSN_ACCEPTED 0x00
+
+// length, type, flags, topic id, message id
+#define MQTTSN_PUBLISH_HEADER 7
+#define MQTTSN_CLIENT_ID_MAX 23
+
+typedef enum {
+    MQTTSN_IDLE,
+    MQTTSN_CONNECTING,
+    MQTTSN_CONNECTED,
+} MqttSnState;
+
+typedef struct InFlight {
+    uint16_t msgId;         // 0 = free
+    uint8_t retries;
+    bool sent;              // sent at least once since the last CONNACK
+    uint32_t sentAtMs;
+    bool reserved;          // handed out by mqttsnReserve, not sent yet
+    uint8_t length;
+    // From the block pools, payloads are formatted straight into it
+    // behind the header. Returned on PUBACK.
+    uint8_t *packet;
+} InFlight;
+
+static struct udp_pcb *pcb;
+static ip_addr_t gatewayAddr;
+static uint16_t gatewayPort;
+static char clientId[MQTTSN_CLIENT_ID_MAX + 1];
+static uint16_t keepAliveS;
+static MqttSnConnectedFn onConnected;
+static void *onConnectedArg;
+
+static volatile MqttSnState state = MQTTSN_IDLE;
+static uint32_t connectSentMs;
+static uint32_t lastTxMs;
+static uint32_t lastRxMs;
+static uint16_t nextMsgId = 1;
+static InFlight window[MQTTSN_WINDOW];
+static InFlight *reservedSlot;
+static MqttSnStats stats;
+
+static inline uint32_t nowMs(void) {
+    return to_ms_since_boot(get_absolute_time());
+}
+
+static inline void put16(uint8_t *out, uint16_t value) {
+    out[0] = (uint8_t) (value >> 8);
+    out[1] = (uint8_t) value;
+}
+
+static inline uint16_t get16(const uint8_t *in) {
+    return (uint16_t) ((in[0] << 8) | in[1]);
+}
+
+// The packet is referenced, not copied. UDP and IP headers go into a pbuf
+// of their own chained in front, and the Wi-Fi driver copies the chain
+// out before udp_sendto returns (ARP queueing clones referenced pbufs).
+static void sendPacket(const uint8_t *packet, uint8_t length) {
+    struct pbuf *p = pbuf_alloc_reference((void *) packet, length, PBUF_REF);
+    if (!p) {
+        return;
+    }
+    udp_sendto(pcb, p, &gatewayAddr, gatewayPort);
+    pbuf_free(p);
+    lastTxMs = nowMs();
+}
+
+static void sendConnect(void) {
+    uint8_t packet[6 + MQTTSN_CLIENT_ID_MAX];
+    const size_t idLength = strlen(clientId);
+    packet[0] = (uint8_t) (6 + idLength);
+    packet[1] = MQTTSN_CONNECT;
+    packet[2] = MQTTSN_FLAG_CLEAN_SESSION;
+    packet[3] = MQTTSN_PROTOCOL_ID;
+    put16(&packet[4], keepAliveS);
+    memcpy(&packet[6], clientId, idLength);
+    sendPacket(packet, packet[0]);
+    connectSentMs = lastTxMs;
+}
+
+static void sendSimple(uint8_t type) {
+    const uint8_t packet[2] = {2, type};
+    sendPacket(packet, sizeof(packet));
+}
+
+static void transmit(InFlight *slot) {
+    if (slot->sent) {
+        slot->packet[2] |= MQTTSN_FLAG_DUP;
+        slot->retries++;
+        stats.retries++;
+    } else {
+        slot->sent = true;
+        stats.sent++;
+    }
+    sendPacket(slot->packet, slot->length);
+    slot->sentAtMs = lastTxMs;
+}
+
+static void startConnecting(void) {
+    state = MQTTSN_CONNECTING;
+    // Whatever was sent may never have arrived, it all goes again
+    for (size_t i = 0; i < MQTTSN_WINDOW; i++) {
+        window[i].retries = 0;
+    }
+    sendConnect();
+}
+
+static void gatewayLost(void) {
+    LOG_WARN("MQTT-SN gateway lost, reconnecting");
+    stats.reconnects++;
+    startConnecting();
+}
+
+static void handleConnack(const uint8_t *body, size_t length) {
+    if (state != MQTTSN_CONNECTING || length < 1) {
+        return;
+    }
+    if (body[0] != MQTTSN_ACCEPTED) {
+        LOG_WARN("MQTT-SN connect refused %d", body[0]);
+        return;
+    }
+    state = MQTTSN_CONNECTED;
+    for (size_t i = 0; i < MQTTSN_WINDOW; i++) {
+        if (window[i].msgId) {
+            transmit(&window[i]);
+        }
+    }
+    if (onConnected) {
+        onConnected(onConnectedArg);
+    }
+}
+
+static void handlePuback(const uint8_t *body, size_t length) {
+    if (length < 5) {
+        return;
+    }
+    const uint16_t msgId = get16(&body[2]);
+    for (size_t i = 0; i < MQTTSN_WINDOW; i++) {
+        if (window[i].msgId != msgId) {
+            continue;
+        }
+        if (body[4] == MQTTSN_ACCEPTED) {
+            stats.acked++;
+        } else {
+            stats.rejected++;
+            LOG_WARN("MQTT-SN topic %lu rejected %d", get16(&body[0]), body[4]);
+        }
+        window[i].msgId = 0;
+        poolFreeBlock(window[i].packet);
+        window[i].packet = NULL;
+        return;
+    }
+}
+
+static void received(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    (void) arg;
+    (void) upcb;
+    (void) port;
+    uint8_t packet[16];
+    const u16_t length = pbuf_copy_partial(p, packet, sizeof(packet), 0);
+    pbuf_free(p);
+    if (!ip_addr_cmp(addr, &gatewayAddr) || length < 2 || packet[0] > length || packet[0] < 2) {
+        return;
+    }
+
+    lastRxMs = nowMs();
+    const uint8_t *body = &packet[2];
+    const size_t bodyLength = packet[0] - 2;
+    switch (packet[1]) {
+        case MQTTSN_CONNACK:
+            handleConnack(body, bodyLength);
+            break;
+        case MQTTSN_PUBACK:
+            handlePuback(body, bodyLength);
+            break;
+        case MQTTSN_DISCONNECT:
+            gatewayLost();
+            break;
+        default:
+            // PINGRESP only refreshes lastRxMs
+            break;
+    }
+}
+
+static void tick(void *arg) {
+    (void) arg;
+    const uint32_t now = nowMs();
+
+    if (state == MQTTSN_CONNECTING) {
+        if (now - connectSentMs >= MQTTSN_RETRY_MS) {
+            // Keeps trying at the same pace, the gateway may come back
+            sendConnect();
+        }
+    } else if (state == MQTTSN_CONNECTED) {
+        for (size_t i = 0; i < MQTTSN_WINDOW; i++) {
+            InFlight *slot = &window[i];
+            if (!slot->msgId || now - slot->sentAtMs < MQTTSN_RETRY_MS) {
+                continue;
+            }
+            if (slot->retries >= MQTTSN_MAX_RETRIES) {
+                gatewayLost();
+                break;
+            }
+            transmit(slot);
+        }
+        if (state == MQTTSN_CONNECTED && keepAliveS) {
+            if (now - lastRxMs >= keepAliveS * 1500u) {
+                gatewayLost();
+            } else if (now - lastTxMs >= keepAliveS * 1000u) {
+                sendSimple(MQTTSN_PINGREQ);
+            }
+        }
+    }
+
+    sys_timeout(MQTTSN_TICK_MS, tick, NULL);
+}
+
+bool mqttsnStart(const ip_addr_t *gateway, uint16_t port, const char *id, uint16_t keepAlive,
+                 MqttSnConnectedFn connected, void *arg) {
+    if (pcb || strlen(id) > MQTTSN_CLIENT_ID_MAX) {
+        return false;
+    }
+    pcb = udp_new();
+    if (!pcb) {
+        return false;
+    }
+    udp_recv(pcb, received, NULL);
+
+    ip_addr_copy(gatewayAddr, *gateway);
+    gatewayPort = port;
+    strcpy(clientId, id);
+    keepAliveS = keepAlive;
+    onConnected = connected;
+    onConnectedArg = arg;
+    lastRxMs = nowMs();
+
+    startConnecting();
+    sys_timeout(MQTTSN_TICK_MS, tick, NULL);
+    return true;
+}
+
+static InFlight *claimSlot(void) {
+    for (size_t i = 0; i < MQTTSN_WINDOW; i++) {
+        if (!window[i].msgId && !window[i].reserved) {
+            window[i].reserved = true;
+            return &window[i];
+        }
+    }
+    return NULL;
+}
+
+char *mqttsnReserve(size_t size, size_t *capacity, uint32_t waitMs) {
+    if (size > MQTTSN_MAX_PAYLOAD + 1) {
+        return NULL;
+    }
+    for (;;) {
+        uint8_t *packet = poolAllocSize(MQTTSN_PUBLISH_HEADER + size);
+        if (packet) {
+            cyw43_arch_lwip_begin();
+            reservedSlot = claimSlot();
+            cyw43_arch_lwip_end();
+            if (reservedSlot) {
+                reservedSlot->packet = packet;
+                *capacity = size;
+                return (char *) &packet[MQTTSN_PUBLISH_HEADER];
+            }
+            poolFreeBlock(packet);
+        }
+        if (waitMs < MQTTSN_WAIT_POLL_MS) {
+            stats.windowFull++;
+            return NULL;
+        }
+        waitMs -= MQTTSN_WAIT_POLL_MS;
+        vTaskDelay(pdMS_TO_TICKS(MQTTSN_WAIT_POLL_MS));
+    }
+}
+
+bool mqttsnSend(uint16_t topicId, size_t len) {
+    InFlight *slot = reservedSlot;
+    if (!slot) {
+        return false;
+    }
+    reservedSlot = NULL;
+
+    cyw43_arch_lwip_begin();
+    slot->reserved = false;
+    if (len > MQTTSN_MAX_PAYLOAD) {
+        poolFreeBlock(slot->packet);
+        slot->packet = NULL;
+        cyw43_arch_lwip_end();
+        return false;
+    }
+    // The payload is already in place behind the header
+    slot->msgId = nextMsgId++;
+    if (!nextMsgId) {
+        nextMsgId = 1;
+    }
+    slot->retries = 0;
+    slot->sent = false;
+    slot->length = (uint8_t) (MQTTSN_PUBLISH_HEADER + len);
+    slot->packet[0] = slot->length;
+    slot->packet[1] = MQTTSN_PUBLISH;
+    slot->packet[2] = MQTTSN_FLAG_QOS1 | MQTTSN_TOPIC_PREDEFINED;
+    put16(&slot->packet[3], topicId);
+    put16(&slot->packet[5], slot->msgId);
+    // Otherwise it goes out with the rest after CONNACK
+    if (state == MQTTSN_CONNECTED) {
+        transmit(slot);
+    }
+    cyw43_arch_lwip_end();
+    return true;
+}
+
+bool mqttsnConnected(void) {
+    return state == MQTTSN_CONNECTED;
+}
+
+void mqttsnGetStats(MqttSnStats *out) {
+    cyw43_arch_lwip_begin();
+    *out = stats;
+    cyw43_arch_lwip_end();
+}
@@ -0,0 +1,54 @@
+#ifndef MQTTSN_H
+#define MQTTSN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/ip_addr.h"
+
+// MQTT-SN 1.2 client over UDP, publish only. Topics are predefined ids the
+// gateway maps to names, so no REGISTER round trips. Every publish is QoS 1:
+// it stays in a small window until the gateway sends PUBACK and is resent
+// with DUP set until then, across reconnects too.
+
+// Publishes waiting for PUBACK, their packets come from pool.h
+#define MQTTSN_WINDOW 4
+// Largest payload, the length byte limits packets to 255
+#define MQTTSN_MAX_PAYLOAD 128
+// Tretry and Nretry of the spec, after that the gateway counts as lost
+#define MQTTSN_RETRY_MS 2000
+#define MQTTSN_MAX_RETRIES 5
+
+typedef struct MqttSnStats {
+    uint32_t sent;          // first transmissions
+    uint32_t retries;       // retransmissions with DUP set
+    uint32_t acked;
+    uint32_t rejected;      // PUBACK with an error, e.g. unknown topic id
+    uint32_t windowFull;    // publishes refused because nothing was acked
+    uint32_t reconnects;
+} MqttSnStats;
+
+// Called in lwIP context on every CONNACK
+typedef void (*MqttSnConnectedFn)(void *arg);
+
+// Starts connecting to the gateway, in lwIP context. Keeps reconnecting on
+// its own when the gateway stops answering.
+bool mqttsnStart(const ip_addr_t *gateway, uint16_t port, const char *clientId, uint16_t keepAliveS,
+                 MqttSnConnectedFn connected, void *arg);
+
+// Zero-copy publish from one task: reserves a window slot and a packet
+// buffer for `size` payload bytes, including a NUL, waiting up to waitMs
+// for an acknowledgement to free them. Returns where the payload is to be
+// written, NULL if there was no room. The caller then still owns what it
+// meant to send and has to keep it for later, nothing was queued.
+char *mqttsnReserve(size_t size, size_t *capacity, uint32_t waitMs);
+
+// Sends the reserved slot as a QoS 1 publish of len bytes. It is kept for
+// retransmission until PUBACK, so nothing is copied.
+bool mqttsnSend(uint16_t topicId, size_t len);
+
+bool mqttsnConnected(void);
+void mqttsnGetStats(MqttSnStats *out);
+
+#endif //MQTTSN_H
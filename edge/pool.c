@@ -0,0 +1,112 @@
+#include "pool.h"
+
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+
+// Sized for the publish buffers: values and stream stats fit the first
+// class, samples and reports the second, aggregates the last. MQTT-SN
+// adds its 7 byte header to each.
+POOL_DEFINE(small, 48, 8);
+POOL_DEFINE(medium, 96, 8);
+POOL_DEFINE(large, 144, 8);
+
+static Pool *const classes[POOL_CLASS_COUNT] = { &small, &medium, &large };
+
+// One lock for all pools, held for a handful of instructions
+static spin_lock_t *lock;
+
+void poolSetup(void) {
+    if (!lock) {
+        lock = spin_lock_instance(spin_lock_claim_unused(true));
+    }
+}
+
+void poolInit(Pool *pool) {
+    pool->_freeList = NULL;
+    for (uint16_t i = pool->blocks; i > 0; i--) {
+        void **block = (void **) &pool->storage[(size_t) (i - 1) * pool->blockSize];
+        *block = pool->_freeList;
+        pool->_freeList = block;
+    }
+    pool->_free = pool->blocks;
+    pool->_minFree = pool->blocks;
+    pool->_allocs = 0;
+    pool->_failures = 0;
+}
+
+void *poolAlloc(Pool *pool) {
+    const uint32_t irq = spin_lock_blocking(lock);
+    void **block = pool->_freeList;
+    if (block) {
+        pool->_freeList = *block;
+        pool->_free--;
+        if (pool->_free < pool->_minFree) {
+            pool->_minFree = pool->_free;
+        }
+        pool->_allocs++;
+    } else {
+        pool->_failures++;
+    }
+    spin_unlock(lock, irq);
+    return block;
+}
+
+void poolFree(Pool *pool, void *block) {
+    const uint32_t irq = spin_lock_blocking(lock);
+    *(void **) block = pool->_freeList;
+    pool->_freeList = block;
+    pool->_free++;
+    spin_unlock(lock, irq);
+}
+
+void poolGetStats(const Pool *pool, PoolStats *out) {
+    const uint32_t irq = spin_lock_blocking(lock);
+    out->blockSize = pool->blockSize;
+    out->blocks = pool->blocks;
+    out->free = pool->_free;
+    out->minFree = pool->_minFree;
+    out->allocs = pool->_allocs;
+    out->failures = pool->_failures;
+    spin_unlock(lock, irq);
+}
+
+static inline bool owns(const Pool *pool, const void *block) {
+    const uint8_t *p = block;
+    return p >= pool->storage && p < pool->storage + (size_t) pool->blocks * pool->blockSize;
+}
+
+void poolClassesInit(void) {
+    poolSetup();
+    for (size_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        poolInit(classes[i]);
+    }
+}
+
+void *poolAllocSize(size_t size) {
+    for (size_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        if (size > classes[i]->blockSize) {
+            continue;
+        }
+        void *block = poolAlloc(classes[i]);
+        if (block) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+void poolFreeBlock(void *block) {
+    if (!block) {
+        return;
+    }
+    for (size_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        if (owns(classes[i], block)) {
+            poolFree(classes[i], block);
+            return;
+        }
+    }
+}
+
+void poolClassStats(uint8_t index, PoolStats *out) {
+    poolGetStats(classes[index], out);
+}
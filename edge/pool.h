@@ -0,0 +1,63 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-size block pools next to the FreeRTOS heap, for buffers that come
+// and go while running. Alloc and free pop and push a free list, so they
+// are O(1), never fragment, and are safe from either core and from ISRs.
+// heap_4 stays for what is allocated once at startup.
+
+// Size classes in pool.c
+#define POOL_CLASS_COUNT 3
+
+// Blocks are 8 byte aligned so any struct fits
+#define POOL_ALIGN(size) (((size) + 7u) & ~7u)
+
+typedef struct PoolStats {
+    uint16_t blockSize;
+    uint16_t blocks;
+    uint16_t free;
+    uint16_t minFree;   // low water mark since boot
+    uint32_t allocs;
+    uint32_t failures;  // allocs that found the pool empty
+} PoolStats;
+
+typedef struct Pool {
+    uint8_t *storage;
+    uint16_t blockSize;
+    uint16_t blocks;
+
+    void *_freeList;    // threaded through the free blocks
+    uint16_t _free;
+    uint16_t _minFree;
+    uint32_t _allocs;
+    uint32_t _failures;
+} Pool;
+
+// Defines the storage and the pool, which still needs poolInit
+#define POOL_DEFINE(name, size, count) \
+    static uint8_t name##Storage[(count) * POOL_ALIGN(size)] __attribute__((aligned(8))); \
+    static Pool name = { .storage = name##Storage, .blockSize = POOL_ALIGN(size), .blocks = (count) }
+
+// Claims the spin lock shared by all pools, once before any poolInit
+void poolSetup(void);
+
+void poolInit(Pool *pool);
+// NULL when the pool is empty
+void *poolAlloc(Pool *pool);
+void poolFree(Pool *pool, void *block);
+void poolGetStats(const Pool *pool, PoolStats *out);
+
+// Size classes, see pool.c. Sets up and initialises every class.
+void poolClassesInit(void);
+// Block from the smallest class that fits, or the next one up when that is
+// empty. NULL when nothing fits.
+void *poolAllocSize(size_t size);
+// Returns a block from poolAllocSize, the class is found from the address
+void poolFreeBlock(void *block);
+void poolClassStats(uint8_t index, PoolStats *out);
+
+#endif //POOL_H
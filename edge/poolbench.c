@@ -0,0 +1,140 @@
+#include "poolbench.h"
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "pool.h"
+#include "cycles.h"
+
+// Random alloc/free churn with long lived blocks pinned now and then,
+// which is what fragments a first fit heap over a long run. Sized to stay
+// within the pool classes of pool.c.
+#define POOLBENCH_ROUNDS 200000
+#define POOLBENCH_REPORT_EVERY 50000
+#define POOLBENCH_LIVE 16
+#define POOLBENCH_PINNED 6
+#define POOLBENCH_PIN_EVERY 20000
+
+// Payload sizes the publishers ask for
+static const uint16_t sizes[] = { 32, 48, 80, 88, 96, 128 };
+#define POOLBENCH_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+typedef struct BenchResult {
+    uint32_t ops;
+    uint32_t failures;
+    uint64_t cycles;
+    uint32_t maxCycles;
+} BenchResult;
+
+typedef struct Allocator {
+    const char *name;
+    void *(*alloc)(size_t size);
+    void (*free)(void *block);
+    bool isHeap;
+} Allocator;
+
+static uint32_t rngState;
+
+static uint32_t nextRandom(void) {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static inline void account(BenchResult *result, uint32_t cycles) {
+    result->ops++;
+    result->cycles += cycles;
+    if (cycles > result->maxCycles) {
+        result->maxCycles = cycles;
+    }
+}
+
+static void *timedAlloc(const Allocator *allocator, size_t size, BenchResult *result) {
+    const uint32_t start = cyclesNow();
+    void *block = allocator->alloc(size);
+    account(result, cyclesSince(start));
+    if (!block) {
+        result->failures++;
+    }
+    return block;
+}
+
+static void timedFree(const Allocator *allocator, void *block, BenchResult *result) {
+    const uint32_t start = cyclesNow();
+    allocator->free(block);
+    account(result, cyclesSince(start));
+}
+
+static void report(const Allocator *allocator, uint32_t round, const BenchResult *result) {
+    printf("  %s @%lu: avg %lu cycles, max %lu, failed %lu",
+           allocator->name, (unsigned long) round,
+           result->ops ? (unsigned long) (result->cycles / result->ops) : 0ul,
+           (unsigned long) result->maxCycles, (unsigned long) result->failures);
+    if (allocator->isHeap) {
+        HeapStats_t heap;
+        vPortGetHeapStats(&heap);
+        const size_t freeBytes = heap.xAvailableHeapSpaceInBytes;
+        const size_t largest = heap.xSizeOfLargestFreeBlockInBytes;
+        printf(", free %u in %u blocks, largest %u, fragmentation %u%%\n",
+               freeBytes, heap.xNumberOfFreeBlocks, largest,
+               freeBytes ? (unsigned) (100 - (uint64_t) largest * 100 / freeBytes) : 0u);
+    } else {
+        // Pools cannot fragment, what they lose is the unused end of blocks
+        printf(", blocks free");
+        for (uint8_t i = 0; i < POOL_CLASS_COUNT; i++) {
+            PoolStats stats;
+            poolClassStats(i, &stats);
+            printf(" %u:%u/%u", stats.blockSize, stats.free, stats.blocks);
+        }
+        printf("\n");
+    }
+}
+
+static void run(const Allocator *allocator) {
+    void *live[POOLBENCH_LIVE] = { 0 };
+    void *pinned[POOLBENCH_PINNED] = { 0 };
+    uint8_t pinnedCount = 0;
+    BenchResult result = { 0 };
+    // Same sequence for every allocator
+    rngState = 0x2545F491;
+
+    for (uint32_t round = 1; round <= POOLBENCH_ROUNDS; round++) {
+        const uint32_t r = nextRandom();
+        const uint32_t slot = r % POOLBENCH_LIVE;
+        if (live[slot]) {
+            timedFree(allocator, live[slot], &result);
+            live[slot] = NULL;
+        } else {
+            live[slot] = timedAlloc(allocator, sizes[(r >> 8) % POOLBENCH_SIZES], &result);
+        }
+        if (round % POOLBENCH_PIN_EVERY == 0 && pinnedCount < POOLBENCH_PINNED) {
+            pinned[pinnedCount++] = timedAlloc(allocator, sizes[(r >> 16) % POOLBENCH_SIZES], &result);
+        }
+        // Taken while blocks are still allocated, that is when it matters
+        if (round % POOLBENCH_REPORT_EVERY == 0) {
+            report(allocator, round, &result);
+        }
+    }
+
+    for (uint32_t i = 0; i < POOLBENCH_LIVE; i++) {
+        if (live[i]) allocator->free(live[i]);
+    }
+    for (uint8_t i = 0; i < pinnedCount; i++) {
+        if (pinned[i]) allocator->free(pinned[i]);
+    }
+}
+
+void poolBenchRun(void) {
+    static const Allocator allocators[] = {
+        { "pvPortMalloc", pvPortMalloc, vPortFree, true },
+        { "pool", poolAllocSize, poolFreeBlock, false },
+    };
+
+    printf("Pool benchmark, %d rounds, %d live blocks\n", POOLBENCH_ROUNDS, POOLBENCH_LIVE);
+    for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+        run(&allocators[i]);
+    }
+}
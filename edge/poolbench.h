@@ -0,0 +1,10 @@
+#ifndef POOLBENCH_H
+#define POOLBENCH_H
+
+// Compares pvPortMalloc with the block pools on the same random alloc/free
+// sequence: cycles per call and, for heap_4, fragmentation as the run goes
+// on. Prints to stdio. Call from a task on core 0 with nothing else using
+// the pools, built in with POOL_BENCH=1.
+void poolBenchRun(void);
+
+#endif //POOLBENCH_H
@@ -0,0 +1,110 @@
+#include "rfid.h"
+
+#include <string.h>
+#include <pico/stdlib.h>
+
+#include "task.h"
+#include "log.h"
+
+// Longer than the MFRC522 timer, reached only when its interrupt got lost
+#define RFID_REQA_TIMEOUT_MS 40
+
+typedef struct Reader {
+    MFRC522Ptr_t mfrc;
+    uint8_t index;
+    bool waiting;
+    TickType_t sentAt;
+} Reader;
+
+static Reader readers[RFID_MAX_READERS];
+static uint8_t readerCount;
+static QueueHandle_t eventQueue;
+static RfidStats stats;
+
+static void cardAnswered(Reader *reader) {
+    RfidEvent event = {
+        .reader = reader->index,
+        .atMs = to_ms_since_boot(get_absolute_time()),
+    };
+    // Select is a few round trips, the other readers keep their REQA going
+    if (!PICC_ReadCardSerial(reader->mfrc)) {
+        stats.selectFailures++;
+        return;
+    }
+    const Uid *uid = &reader->mfrc->uid;
+    event.uidSize = uid->size <= sizeof(event.uid) ? uid->size : sizeof(event.uid);
+    memcpy(event.uid, uid->uidByte, event.uidSize);
+    // Quiet until it leaves the field and comes back
+    PICC_HaltA(reader->mfrc);
+
+    stats.cards++;
+    if (xQueueSendToBack(eventQueue, &event, 0U) != pdTRUE) {
+        stats.dropped++;
+        LOG_WARN("Reader %u event queue full", reader->index);
+    }
+}
+
+static void poll(Reader *reader, TickType_t now) {
+    if (!reader->waiting) {
+        PICC_StartRequestA(reader->mfrc);
+        reader->waiting = true;
+        reader->sentAt = now;
+        stats.polls++;
+        return;
+    }
+
+    switch (PICC_PollRequestA(reader->mfrc)) {
+    case STATUS_BUSY:
+        if (now - reader->sentAt < pdMS_TO_TICKS(RFID_REQA_TIMEOUT_MS)) {
+            return;
+        }
+        break;
+    case STATUS_OK:
+    case STATUS_COLLISION:
+        cardAnswered(reader);
+        break;
+    default:
+        break;
+    }
+    // Next REQA on the following pass
+    reader->waiting = false;
+}
+
+static void prvRfidTask(void *pvParameters) {
+    (void) pvParameters;
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        const TickType_t now = xTaskGetTickCount();
+        for (uint8_t i = 0; i < readerCount; i++) {
+            poll(&readers[i], now);
+        }
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(RFID_POLL_MS));
+    }
+}
+
+bool rfidStart(MFRC522Ptr_t *table, uint8_t count, QueueHandle_t events,
+               UBaseType_t priority, uint32_t stackWords) {
+    readerCount = 0;
+    for (uint8_t i = 0; i < count && readerCount < RFID_MAX_READERS; i++) {
+        if (!table[i] || !PCD_IsPresent(table[i])) {
+            LOG_WARN("Reader %u not found", i);
+            continue;
+        }
+        readers[readerCount++] = (Reader) { .mfrc = table[i], .index = i };
+    }
+    if (!readerCount) {
+        return false;
+    }
+    eventQueue = events;
+
+    return xTaskCreate(prvRfidTask,
+                       "Rfid",
+                       stackWords,
+                       NULL,
+                       priority,
+                       NULL) == pdPASS;
+}
+
+void rfidGetStats(RfidStats *out) {
+    *out = stats;
+}
@@ -0,0 +1,39 @@
+#ifndef RFID_H
+#define RFID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "mfrc522.h"
+
+// Polls several MFRC522 readers on one SPI bus from one task. REQA goes out
+// to every reader at once and each is checked every RFID_POLL_MS, so a card
+// is seen within one MFRC522 timeout (25 ms) of arriving at any reader.
+// Cards are halted once read, so one held in the field is reported once.
+#define RFID_MAX_READERS 2
+#define RFID_POLL_MS 2
+
+typedef struct RfidEvent {
+    uint8_t reader;         // index in the table given to rfidStart
+    uint8_t uidSize;
+    uint8_t uid[10];
+    uint32_t atMs;          // since boot, when the card answered REQA
+} RfidEvent;
+
+typedef struct RfidStats {
+    uint32_t polls;         // REQA rounds over all readers
+    uint32_t cards;
+    uint32_t selectFailures;
+    uint32_t dropped;       // events that found the queue full
+} RfidStats;
+
+// Starts the polling task. Readers must have been through PCD_Init, those
+// that do not answer PCD_IsPresent are left out. Events go to the back of
+// the queue without waiting.
+bool rfidStart(MFRC522Ptr_t *readers, uint8_t count, QueueHandle_t events,
+               UBaseType_t priority, uint32_t stackWords);
+void rfidGetStats(RfidStats *out);
+
+#endif //RFID_H
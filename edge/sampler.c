@@ -0,0 +1,396 @@
+#include "sampler.h"
+
+#include <string.h>
+#include <pico/stdlib.h>
+
+#include "task.h"
+#include "log.h"
+#include "crc32.h"
+#include "hotpath.h"
+
+#define SAMPLER_MAX_STREAMS 16
+// Closed windows waiting to be published per stream
+#define SAMPLER_AGGREGATE_QUEUE_LENGTH 2
+// Longest the task sleeps, so its heartbeat stays fresh with long periods
+#define SAMPLER_MAX_WAIT_MS 1000
+
+// Queued samples are mirrored into RAM that is not cleared at boot until
+// they are published, so a watchdog reset does not lose them
+#define SAMPLER_RETAIN_MAGIC 0x4E544552 // "RETN"
+#define SAMPLER_RETAIN_STREAMS 4
+#define SAMPLER_RETAIN_SLOTS 16
+
+typedef struct RetainedSlot {
+    Sample sample;
+    uint32_t crc;
+} RetainedSlot;
+
+typedef struct RetainedStream {
+    // Next sequence number to publish, stored inverted as well so a reset
+    // in the middle of an update is noticed
+    uint32_t published;
+    uint32_t publishedCheck;
+    RetainedSlot slots[SAMPLER_RETAIN_SLOTS];  // indexed by seq
+} RetainedStream;
+
+typedef struct Retained {
+    uint32_t magic;
+    uint32_t streamCount;
+    RetainedStream streams[SAMPLER_RETAIN_STREAMS];
+} Retained;
+
+static Retained __uninitialized_ram(retained);
+
+static SamplerStream *streams;
+static uint8_t streamCount;
+static TaskHandle_t samplerTask = NULL;
+static volatile uint32_t budgetPerMinute = 0;
+static volatile TickType_t heartbeat;
+
+// Min-heap of stream indices ordered by their next deadline
+static uint8_t heap[SAMPLER_MAX_STREAMS];
+
+// Tick counts wrap, compare through the signed difference
+static inline bool dueBefore(uint8_t a, uint8_t b) {
+    return (int32_t) (streams[a]._due - streams[b]._due) < 0;
+}
+
+static inline void heapSwap(uint8_t i, uint8_t j) {
+    uint8_t tmp = heap[i];
+    heap[i] = heap[j];
+    heap[j] = tmp;
+}
+
+static void heapSiftDown(uint8_t i) {
+    for (;;) {
+        uint8_t smallest = i;
+        uint8_t left = 2 * i + 1;
+        uint8_t right = left + 1;
+        if (left < streamCount && dueBefore(heap[left], heap[smallest])) smallest = left;
+        if (right < streamCount && dueBefore(heap[right], heap[smallest])) smallest = right;
+        if (smallest == i) return;
+        heapSwap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void heapBuild(void) {
+    for (uint8_t i = 0; i < streamCount; i++) {
+        heap[i] = i;
+    }
+    for (int i = streamCount / 2 - 1; i >= 0; i--) {
+        heapSiftDown((uint8_t) i);
+    }
+}
+
+// What is left of the budget once every other stream has its share
+static uint32_t rateLeftFor(const SamplerStream *stream) {
+    const uint32_t budget = budgetPerMinute;
+    if (!budget) {
+        return 0;
+    }
+    uint32_t used = 0;
+    for (uint8_t i = 0; i < streamCount; i++) {
+        if (&streams[i] != stream) {
+            used += 60000 / (streams[i].period * portTICK_PERIOD_MS);
+        }
+    }
+    // Never starve a stream completely, it still gets its max period
+    return used < budget ? budget - used : 1;
+}
+
+// Queues the window once it has run its length. Called with every reading
+// and from the task loop, so a window also closes when its stream stops
+// delivering readings, e.g. the gas stream outside the MQ-7's measuring
+// phase. Returns the ticks left until it would close, portMAX_DELAY
+// without an open window.
+static TickType_t HOT_PATH(aggregateClose)(SamplerStream *stream, TickType_t now) {
+    const TickType_t window = stream->aggregateWindow;
+    Aggregate *agg = &stream->_window;
+    if (!window || !agg->count) {
+        return portMAX_DELAY;
+    }
+    const TickType_t open = now - stream->_windowStart;
+    if (open < window) {
+        return window - open;
+    }
+    if (xQueueSendToBack(stream->aggregates, agg, 0U) != pdTRUE) {
+        stream->aggregatesDropped++;
+        LOG_WARN("%s aggregate queue full, dropped window %lu", (uintptr_t) stream->name, agg->seq);
+    }
+    agg->seq++;
+    agg->count = 0;
+    return portMAX_DELAY;
+}
+
+static void HOT_PATH(aggregateAdd)(SamplerStream *stream, uint32_t value, TickType_t now, uint64_t capturedUs) {
+    Aggregate *agg = &stream->_window;
+    if (!stream->aggregateWindow) {
+        agg->count = 0;
+        return;
+    }
+
+    (void) aggregateClose(stream, now);
+    if (!agg->count) {
+        stream->_windowStart = now;
+        agg->min = UINT32_MAX;
+        agg->max = 0;
+        agg->sum = 0;
+        agg->sumSquares = 0;
+        agg->firstUs = capturedUs;
+    }
+
+    agg->count++;
+    if (value < agg->min) agg->min = value;
+    if (value > agg->max) agg->max = value;
+    agg->sum += value;
+    agg->sumSquares += (uint64_t) value * value;
+    agg->lastUs = capturedUs;
+}
+
+static bool HOT_PATH(withinDeadband)(const SamplerStream *stream, uint32_t value, TickType_t now) {
+    if (!stream->_hasLast) {
+        return false;
+    }
+
+    const TickType_t maxSilence = stream->maxSilence;
+    if (maxSilence && now - stream->_lastQueuedAt >= maxSilence) {
+        return false;
+    }
+
+    uint32_t deadband = stream->deadband;
+    const uint32_t relative = (uint32_t) (((uint64_t) stream->_lastQueued * stream->deadbandPermille) / 1000);
+    if (relative > deadband) {
+        deadband = relative;
+    }
+    if (!deadband) {
+        return false;
+    }
+
+    uint32_t delta = value > stream->_lastQueued ? value - stream->_lastQueued : stream->_lastQueued - value;
+    return delta <= deadband;
+}
+
+static RetainedStream *retainedFor(const SamplerStream *stream) {
+    const ptrdiff_t index = stream - streams;
+    return index < SAMPLER_RETAIN_STREAMS ? &retained.streams[index] : NULL;
+}
+
+static void retainSample(const SamplerStream *stream, const Sample *sample) {
+    RetainedStream *rs = retainedFor(stream);
+    if (!rs) {
+        return;
+    }
+    RetainedSlot *slot = &rs->slots[sample->seq % SAMPLER_RETAIN_SLOTS];
+    slot->sample = *sample;
+    slot->crc = crc32(&slot->sample, sizeof(slot->sample));
+}
+
+// Queues what was retained but never published, oldest first, and carries
+// on with the sequence where it stopped. Returns how many were queued.
+static uint32_t retainRecover(SamplerStream *stream) {
+    RetainedStream *rs = retainedFor(stream);
+    if (!rs) {
+        return 0;
+    }
+    if (rs->publishedCheck != ~rs->published) {
+        // Nothing tells the stale slots from the pending ones
+        memset(rs, 0, sizeof(*rs));
+        rs->publishedCheck = ~0u;
+        return 0;
+    }
+
+    const uint32_t published = rs->published;
+    stream->sequence = published;
+    uint32_t recovered = 0;
+    for (uint32_t seq = published; seq - published < SAMPLER_RETAIN_SLOTS; seq++) {
+        const RetainedSlot *slot = &rs->slots[seq % SAMPLER_RETAIN_SLOTS];
+        // Numbers dropped on a full queue were never retained
+        if (slot->sample.seq != seq || crc32(&slot->sample, sizeof(slot->sample)) != slot->crc) {
+            continue;
+        }
+        // Taken on the previous boot's clock, the reset restarted the timer
+        Sample sample = slot->sample;
+        sample.capturedUs = 0;
+        if (xQueueSendToBack(stream->queue, &sample, 0U) != pdTRUE) {
+            break;
+        }
+        stream->sequence = seq + 1;
+        recovered++;
+    }
+    return recovered;
+}
+
+static void retainInit(uint8_t count) {
+    if (retained.magic == SAMPLER_RETAIN_MAGIC && retained.streamCount == count) {
+        return;
+    }
+    memset(&retained, 0, sizeof(retained));
+    for (uint8_t i = 0; i < SAMPLER_RETAIN_STREAMS; i++) {
+        retained.streams[i].publishedCheck = ~0u;
+    }
+    retained.streamCount = count;
+    retained.magic = SAMPLER_RETAIN_MAGIC;
+}
+
+static void HOT_PATH(sampleStream)(SamplerStream *stream) {
+    uint32_t value;
+    // Stamped here rather than at publish, batches can sit for a while
+    const uint64_t capturedUs = time_us_64();
+    if (!stream->read(stream, &value)) {
+        return;
+    }
+    if (stream->filter) {
+        value = stream->filter(stream, value);
+    }
+    if (stream->adaptive) {
+        uint32_t periodMs = stream->period * portTICK_PERIOD_MS;
+        periodMs = adaptiveUpdate(stream->adaptive, value, periodMs, rateLeftFor(stream));
+        stream->period = pdMS_TO_TICKS(periodMs);
+    }
+    const TickType_t now = xTaskGetTickCount();
+    aggregateAdd(stream, value, now, capturedUs);
+    if (!stream->forwardRaw) {
+        return;
+    }
+    if (withinDeadband(stream, value, now)) {
+        stream->_suppressed++;
+        return;
+    }
+
+    Sample sample = {
+        .value = value,
+        .suppressed = stream->_suppressed,
+        .held = stream->_lastQueued,
+        .capturedUs = capturedUs,
+        .seq = stream->sequence++,
+    };
+    stream->_lastQueued = value;
+    stream->_lastQueuedAt = now;
+    stream->_suppressed = 0;
+    stream->_hasLast = true;
+    LOG_DEBUG("%s value %lu seq %lu", (uintptr_t) stream->name, value, sample.seq);
+    if (xQueueSendToBack(stream->queue, &sample, 0U) != pdTRUE) {
+        stream->dropped++;
+        LOG_WARN("%s queue full, dropped seq %lu", (uintptr_t) stream->name, sample.seq);
+        return;
+    }
+    retainSample(stream, &sample);
+}
+
+// Pulls in deadlines that a shortened period has left too far out
+static void reschedule(TickType_t now) {
+    for (uint8_t i = 0; i < streamCount; i++) {
+        if ((int32_t) (streams[i]._due - (now + streams[i].period)) > 0) {
+            streams[i]._due = now + streams[i].period;
+        }
+    }
+    heapBuild();
+}
+
+static void prvSamplerTask(void *pvParameters) {
+    (void) pvParameters;
+
+    TickType_t now = xTaskGetTickCount();
+    for (uint8_t i = 0; i < streamCount; i++) {
+        streams[i]._due = now + streams[i].period;
+    }
+    heapBuild();
+
+    for (;;) {
+        SamplerStream *next = &streams[heap[0]];
+        now = xTaskGetTickCount();
+        heartbeat = now;
+        TickType_t windowWait = portMAX_DELAY;
+        for (uint8_t i = 0; i < streamCount; i++) {
+            const TickType_t left = aggregateClose(&streams[i], now);
+            if (left < windowWait) {
+                windowWait = left;
+            }
+        }
+        TickType_t wait = next->_due - now;
+        if ((int32_t) wait > 0) {
+            if (wait > pdMS_TO_TICKS(SAMPLER_MAX_WAIT_MS)) {
+                wait = pdMS_TO_TICKS(SAMPLER_MAX_WAIT_MS);
+            }
+            if (wait > windowWait) {
+                wait = windowWait;
+            }
+            // A notification wakes us early, e.g. when the table changes
+            if (ulTaskNotifyTake(pdTRUE, wait)) {
+                reschedule(xTaskGetTickCount());
+            }
+            continue;
+        }
+
+        sampleStream(next);
+
+        next->_due += next->period;
+        // Fell behind by more than a period, skip instead of bursting
+        if ((int32_t) (next->_due - now) <= 0) {
+            next->_due = now + next->period;
+        }
+        heapSiftDown(0);
+    }
+}
+
+bool samplerStart(SamplerStream *table, uint8_t count, UBaseType_t queueLength,
+                  UBaseType_t priority, uint32_t stackWords) {
+    if (count == 0 || count > SAMPLER_MAX_STREAMS) {
+        return false;
+    }
+    streams = table;
+    streamCount = count;
+    retainInit(count);
+
+    for (uint8_t i = 0; i < count; i++) {
+        streams[i].queue = xQueueCreate(queueLength, sizeof(Sample));
+        streams[i].aggregates = xQueueCreate(SAMPLER_AGGREGATE_QUEUE_LENGTH, sizeof(Aggregate));
+        if (!streams[i].queue || !streams[i].aggregates) {
+            return false;
+        }
+        const uint32_t recovered = retainRecover(&streams[i]);
+        if (recovered) {
+            LOG_INFO("%s resumed %lu unpublished samples", (uintptr_t) streams[i].name, recovered);
+        }
+    }
+    heartbeat = xTaskGetTickCount();
+
+    return xTaskCreate(prvSamplerTask,
+                       "Sampler",
+                       stackWords,
+                       NULL,
+                       priority,
+                       &samplerTask) == pdPASS;
+}
+
+void samplerPublished(const SamplerStream *stream, const Sample *sample) {
+    RetainedStream *rs = retainedFor(stream);
+    if (!rs) {
+        return;
+    }
+    const uint32_t next = sample->seq + 1;
+    rs->published = next;
+    rs->publishedCheck = ~next;
+}
+
+TickType_t samplerHeartbeat(void) {
+    return heartbeat;
+}
+
+void samplerSetBudget(uint32_t samplesPerMinute) {
+    budgetPerMinute = samplesPerMinute;
+}
+
+void samplerKick(void) {
+    if (!samplerTask) {
+        return;
+    }
+    if (portCHECK_IF_IN_ISR()) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(samplerTask, &woken);
+        portYIELD_FROM_ISR(woken);
+    } else {
+        xTaskNotifyGive(samplerTask);
+    }
+}
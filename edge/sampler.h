@@ -0,0 +1,109 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+#include "topics.h"
+#include "adaptive.h"
+
+typedef struct SamplerStream SamplerStream;
+
+// What is queued per reading
+typedef struct Sample {
+    uint32_t value;
+    // Report by exception: readings dropped by the deadband since the
+    // previous queued sample, they were all within the deadband of `held`
+    uint32_t suppressed;
+    uint32_t held;
+    // time_us_64() when the reading was taken, 0 for samples recovered
+    // after a reset, whose time is not known on this boot's clock
+    uint64_t capturedUs;
+    // Per stream, counts every sample handed to the queue, including the
+    // ones dropped because it was full, so a gap means data was lost
+    uint32_t seq;
+} Sample;
+
+// Tumbling window summary of every reading, including suppressed ones
+typedef struct Aggregate {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint64_t sumSquares;
+    uint64_t firstUs;   // time_us_64() of the first and last reading
+    uint64_t lastUs;
+    uint32_t seq;       // per stream window number
+} Aggregate;
+
+// Takes one reading, returns false when there is nothing valid to report
+typedef bool (*SamplerReadFn)(const SamplerStream *stream, uint32_t *value);
+// Optional, turns the raw reading into the value that is queued
+typedef uint32_t (*SamplerFilterFn)(SamplerStream *stream, uint32_t value);
+
+// One row of the sensor table. Adding a sensor means adding a row,
+// every row is serviced by the same task at its own rate.
+// period, batchSize and the deadband settings may be changed at runtime,
+// they are single words so a plain store from another context is safe.
+// With a deadband set the stream reports by exception: a reading is only
+// queued when it moved far enough from the last queued one, or when
+// maxSilence has passed without anything being queued.
+// With aggregateWindow set, an Aggregate of all readings in the window is
+// queued when it closes; forwardRaw decides whether samples go out as well.
+struct SamplerStream {
+    const char *name;           // also the key used in config topics
+    TopicId topic;
+    SamplerReadFn read;
+    uint32_t channel;           // passed through to read, e.g. ADC input
+    SamplerFilterFn filter;
+    uint32_t filterState;       // owned by the filter
+    const char *unit;           // of the queued values, NULL for raw counts
+    volatile TickType_t period;
+    volatile uint32_t batchSize;    // queued samples before publishing
+    volatile uint32_t deadband;         // absolute, in queued units, 0 = off
+    volatile uint32_t deadbandPermille; // relative to the last queued value, 0 = off
+    volatile TickType_t maxSilence;     // heartbeat, 0 = never forced
+    volatile TickType_t aggregateWindow;    // 0 = no aggregates
+    volatile bool forwardRaw;
+    TopicId aggregateTopic;
+    TopicId statsTopic;
+    AdaptiveState *adaptive;    // optional, lets the signal drive the period
+    QueueHandle_t queue;        // created by samplerStart
+    QueueHandle_t aggregates;   // created by samplerStart
+    uint32_t sequence;                      // next sample sequence number
+    volatile uint32_t dropped;              // samples lost to a full queue
+    volatile uint32_t aggregatesDropped;    // windows lost to a full queue
+
+    TickType_t _due;
+    uint32_t _lastQueued;
+    TickType_t _lastQueuedAt;
+    uint32_t _suppressed;
+    bool _hasLast;
+    Aggregate _window;
+    TickType_t _windowStart;
+};
+
+// Creates a queue per stream and the task that samples them. Streams must
+// stay valid for the lifetime of the program. Samples that were queued but
+// not published before a reset are queued again, and numbering carries on.
+bool samplerStart(SamplerStream *streams, uint8_t count, UBaseType_t queueLength,
+                  UBaseType_t priority, uint32_t stackWords);
+
+// Call once a sample taken from the stream queue has been handed to the
+// network, it is then no longer kept for after a reset
+void samplerPublished(const SamplerStream *stream, const Sample *sample);
+
+// Tick count of the last pass of the sampler task, for the health check
+TickType_t samplerHeartbeat(void);
+
+// Caps the combined rate of the adaptive streams, 0 means no cap
+void samplerSetBudget(uint32_t samplesPerMinute);
+
+// Wakes the sampler so a changed period takes effect right away.
+// Safe to call from an ISR.
+void samplerKick(void);
+
+#endif //SAMPLER_H
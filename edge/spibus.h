@@ -0,0 +1,42 @@
+#ifndef SPIBUS_H
+#define SPIBUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <hardware/gpio.h>
+#include <hardware/spi.h>
+
+// All the SPI drivers (mfrc522.c, mpu9250.c) do on the bus: chip select
+// and blocking transfers. On the Pico these are the SDK calls, inlined.
+// Built with SPIBUS_HOST=1 the drivers run on a PC against the register
+// models in tools/spimodel, which count what goes over the bus.
+#if defined(SPIBUS_HOST) && SPIBUS_HOST
+void spiBusSelect(uint cs);
+void spiBusDeselect(uint cs);
+void spiBusWrite(spi_inst_t *spi, const uint8_t *src, size_t len);
+void spiBusRead(spi_inst_t *spi, uint8_t repeatedTx, uint8_t *dst, size_t len);
+void spiBusWriteRead(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len);
+#else
+// Chip selects are active low
+static inline void spiBusSelect(uint cs) {
+    gpio_put(cs, 0);
+}
+
+static inline void spiBusDeselect(uint cs) {
+    gpio_put(cs, 1);
+}
+
+static inline void spiBusWrite(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    spi_write_blocking(spi, src, len);
+}
+
+static inline void spiBusRead(spi_inst_t *spi, uint8_t repeatedTx, uint8_t *dst, size_t len) {
+    spi_read_blocking(spi, repeatedTx, dst, len);
+}
+
+static inline void spiBusWriteRead(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len) {
+    spi_write_read_blocking(spi, src, dst, len);
+}
+#endif
+
+#endif //SPIBUS_H
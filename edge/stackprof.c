@@ -0,0 +1,48 @@
+#include "stackprof.h"
+
+#include <stdio.h>
+
+#include "task.h"
+
+#define STACKPROF_MAX_TASKS 16
+
+static TickType_t period;
+
+static void report(void) {
+    static TaskStatus_t tasks[STACKPROF_MAX_TASKS];
+    const UBaseType_t count = uxTaskGetSystemState(tasks, STACKPROF_MAX_TASKS, NULL);
+    if (!count) {
+        printf("Stack profile: more than %d tasks\n", STACKPROF_MAX_TASKS);
+        return;
+    }
+
+    printf("Stack profile at %lu ms, words used of allocated\n",
+           (unsigned long) (xTaskGetTickCount() * portTICK_PERIOD_MS));
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *task = &tasks[i];
+        // configRECORD_STACK_HIGH_ADDRESS keeps the last word of the stack
+        const uint32_t size = (uint32_t) (task->pxEndOfStack - task->pxStackBase) + 1;
+        const uint32_t used = size - task->usStackHighWaterMark;
+        printf("  %-12s cores %lx %5lu/%-5lu %3lu%%\n",
+               task->pcTaskName, (unsigned long) task->uxCoreAffinityMask,
+               (unsigned long) used, (unsigned long) size, (unsigned long) (used * 100 / size));
+    }
+}
+
+static void prvStackProfileTask(void *pvParameters) {
+    (void) pvParameters;
+    for (;;) {
+        vTaskDelay(period);
+        report();
+    }
+}
+
+bool stackProfileStart(UBaseType_t priority, uint32_t stackWords, uint32_t periodMs) {
+    period = pdMS_TO_TICKS(periodMs);
+    return xTaskCreate(prvStackProfileTask,
+                       "StackProfile",
+                       stackWords,
+                       NULL,
+                       priority,
+                       NULL) == pdPASS;
+}
@@ -0,0 +1,15 @@
+#ifndef STACKPROF_H
+#define STACKPROF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+// Stack profiling, built in with STACK_PROFILE=1. The kernel paints every
+// new stack, this reports how deep each task has reached into its stack so
+// far while the application runs as the workload. Prints to stdio every
+// periodMs.
+bool stackProfileStart(UBaseType_t priority, uint32_t stackWords, uint32_t periodMs);
+
+#endif //STACKPROF_H
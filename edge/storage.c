@@ -0,0 +1,92 @@
+#include "storage.h"
+
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/flash.h>
+#include <hardware/flash.h>
+
+#include "crc32.h"
+
+#define STORAGE_MAGIC 0x59524246 // "FBRY"
+#define STORAGE_FLASH_TIMEOUT_MS 100
+
+typedef struct StorageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t crc;
+    uint32_t _reserved;
+} StorageHeader;
+
+typedef struct StorageWrite {
+    uint32_t offset;
+    StorageHeader header;
+    const uint8_t *data;
+} StorageWrite;
+
+static inline uint32_t slotOffset(uint8_t slot) {
+    return PICO_FLASH_SIZE_BYTES - (slot + 1) * FLASH_SECTOR_SIZE;
+}
+
+bool storageLoad(uint8_t slot, uint16_t version, void *data, size_t len) {
+    if (slot >= STORAGE_SLOT_COUNT) {
+        return false;
+    }
+
+    const uint8_t *record = (const uint8_t *) (XIP_BASE + slotOffset(slot));
+    StorageHeader header;
+    memcpy(&header, record, sizeof(header));
+    if (header.magic != STORAGE_MAGIC || header.version != version || header.length != len) {
+        return false;
+    }
+
+    const uint8_t *payload = record + sizeof(header);
+    if (crc32(payload, len) != header.crc) {
+        return false;
+    }
+    memcpy(data, payload, len);
+    return true;
+}
+
+// Runs with the other core parked and interrupts disabled, so it only
+// touches RAM and the flash driver.
+static void writeRecord(void *param) {
+    const StorageWrite *write = param;
+    const size_t total = sizeof(StorageHeader) + write->header.length;
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    flash_range_erase(write->offset, FLASH_SECTOR_SIZE);
+    for (size_t pageStart = 0; pageStart < total; pageStart += FLASH_PAGE_SIZE) {
+        memset(page, 0xFF, sizeof(page));
+        for (size_t i = 0; i < FLASH_PAGE_SIZE && pageStart + i < total; i++) {
+            const size_t pos = pageStart + i;
+            page[i] = pos < sizeof(StorageHeader)
+                ? ((const uint8_t *) &write->header)[pos]
+                : write->data[pos - sizeof(StorageHeader)];
+        }
+        flash_range_program(write->offset + pageStart, page, FLASH_PAGE_SIZE);
+    }
+}
+
+bool storageSave(uint8_t slot, uint16_t version, const void *data, size_t len) {
+    if (slot >= STORAGE_SLOT_COUNT || len > STORAGE_MAX_RECORD_SIZE) {
+        return false;
+    }
+
+    StorageWrite write = {
+        .offset = slotOffset(slot),
+        .header = {
+            .magic = STORAGE_MAGIC,
+            .version = version,
+            .length = (uint16_t) len,
+            .crc = crc32(data, len),
+        },
+        .data = data,
+    };
+    if (flash_safe_execute(writeRecord, &write, STORAGE_FLASH_TIMEOUT_MS) != PICO_OK) {
+        return false;
+    }
+
+    // Read back through XIP to make sure the record took
+    return memcmp((const uint8_t *) (XIP_BASE + write.offset) + sizeof(StorageHeader), data, len) == 0;
+}
@@ -0,0 +1,23 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Each slot is one flash sector counted back from the end of flash,
+// so slots never overlap with the program image.
+#define STORAGE_SLOT_COUNT 8
+
+// Largest record payload, a sector minus the record header
+#define STORAGE_MAX_RECORD_SIZE (4096 - 16)
+
+// Copies the record in `slot` into `data` if it is valid, has the expected
+// version and exactly `len` bytes. Reads straight from XIP so it is cheap.
+bool storageLoad(uint8_t slot, uint16_t version, void *data, size_t len);
+
+// Erases the slot and writes a new record. Must not be called from an ISR,
+// the other core is parked while the flash is busy.
+bool storageSave(uint8_t slot, uint16_t version, const void *data, size_t len);
+
+#endif //STORAGE_H
@@ -0,0 +1,81 @@
+#include "timesync.h"
+
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+#include "lwip/apps/sntp.h"
+
+// Drift estimates beyond this are treated as a bad sync
+#define TIMESYNC_MAX_DRIFT_PPM 500
+
+// Written from the lwIP callback on one core, read from tasks on both, so
+// readers retry while the sequence number is odd or has changed.
+static volatile uint32_t seq;
+static uint64_t baseMonoUs;
+static uint64_t baseEpochUs;
+static int32_t driftPpm;
+static bool synced;
+
+static inline int64_t driftCorrection(uint64_t elapsedUs, int32_t ppm) {
+    return ((int64_t) elapsedUs * ppm) / 1000000;
+}
+
+void timesyncSet(uint32_t sec, uint32_t us) {
+    const uint64_t monoUs = time_us_64();
+    const uint64_t epochUs = (uint64_t) sec * 1000000 + us;
+
+    int32_t ppm = driftPpm;
+    if (synced) {
+        // Whatever the model got wrong since the last sync is drift
+        const uint64_t elapsedUs = monoUs - baseMonoUs;
+        const int64_t predicted = (int64_t) (baseEpochUs + elapsedUs) + driftCorrection(elapsedUs, ppm);
+        const int64_t errorUs = (int64_t) epochUs - predicted;
+        if (elapsedUs > 0) {
+            // Half gain keeps one noisy round trip from swinging the rate
+            ppm += (int32_t) ((errorUs * 1000000 / (int64_t) elapsedUs) / 2);
+            if (ppm > TIMESYNC_MAX_DRIFT_PPM) ppm = TIMESYNC_MAX_DRIFT_PPM;
+            if (ppm < -TIMESYNC_MAX_DRIFT_PPM) ppm = -TIMESYNC_MAX_DRIFT_PPM;
+        }
+    }
+
+    seq++;
+    __dmb();
+    baseMonoUs = monoUs;
+    baseEpochUs = epochUs;
+    driftPpm = ppm;
+    synced = true;
+    __dmb();
+    seq++;
+}
+
+void timesyncStart(const char *server) {
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, server);
+    sntp_init();
+}
+
+bool timesyncIsSynced(void) {
+    return synced;
+}
+
+uint64_t timesyncEpochUs(uint64_t monoUs) {
+    uint32_t before;
+    uint64_t mono, epoch;
+    int32_t ppm;
+    bool valid;
+    do {
+        before = seq;
+        __dmb();
+        mono = baseMonoUs;
+        epoch = baseEpochUs;
+        ppm = driftPpm;
+        valid = synced;
+        __dmb();
+    } while ((before & 1) || before != seq);
+
+    if (!valid) {
+        return 0;
+    }
+    // Samples taken before the last sync are stamped backwards from it
+    const int64_t elapsedUs = (int64_t) (monoUs - mono);
+    return (uint64_t) ((int64_t) epoch + elapsedUs + (elapsedUs * ppm) / 1000000);
+}
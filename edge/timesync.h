@@ -0,0 +1,19 @@
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Called by the lwIP SNTP client with the server time, see lwipopts.h
+void timesyncSet(uint32_t sec, uint32_t us);
+
+// Starts polling the given server (name or address), needs the lwIP lock
+void timesyncStart(const char *server);
+
+bool timesyncIsSynced(void);
+
+// Converts a time_us_64() reading to microseconds since the Unix epoch,
+// corrected for the drift measured between syncs. 0 until the first sync.
+uint64_t timesyncEpochUs(uint64_t monoUs);
+
+#endif //TIMESYNC_H
@@ -0,0 +1,100 @@
+#include "tls.h"
+
+#include <malloc.h>
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/cyw43_arch.h>
+#include "mbedtls/ssl.h"
+// struct altcp_tls_session, lives next to the lwIP mbedTLS port
+#include "altcp_tls_mbedtls_structs.h"
+
+#include "storage.h"
+
+typedef struct TlsStoredSession {
+    uint32_t length;
+    uint8_t data[TLS_SESSION_MAX_SIZE];
+} TlsStoredSession;
+
+static uint8_t sessionSlot;
+static struct altcp_tls_session session;
+static bool sessionValid;
+static volatile bool sessionDirty;
+// What is in flash. Too big for the stacks that serialise it.
+static TlsStoredSession stored;
+
+static TlsStats stats;
+static volatile bool statsPending;
+static uint64_t connectStartUs;
+static uint32_t heapBefore;
+static uint32_t arenaBefore;
+
+struct altcp_tls_config *tlsInit(const uint8_t *caCert, size_t caCertLen, uint8_t storageSlot) {
+    sessionSlot = storageSlot;
+    altcp_tls_init_session(&session);
+    if (storageLoad(storageSlot, TLS_SESSION_VERSION, &stored, sizeof(stored))
+        && stored.length <= sizeof(stored.data)) {
+        sessionValid = mbedtls_ssl_session_load(&session.data, stored.data, stored.length) == 0;
+    }
+    return altcp_tls_create_config_client(caCert, caCertLen);
+}
+
+void tlsConnecting(struct altcp_pcb *conn, const char *hostname) {
+    mbedtls_ssl_set_hostname(altcp_tls_context(conn), hostname);
+
+    stats.sessionOffered = sessionValid && altcp_tls_set_session(conn, &session) == ERR_OK;
+    const struct mallinfo heap = mallinfo();
+    heapBefore = heap.uordblks;
+    arenaBefore = heap.arena;
+    connectStartUs = time_us_64();
+}
+
+void tlsConnected(struct altcp_pcb *conn) {
+    const struct mallinfo heap = mallinfo();
+    stats.connects++;
+    stats.connectMs = (uint32_t) ((time_us_64() - connectStartUs) / 1000);
+    stats.heapBytes = heap.uordblks > heapBefore ? heap.uordblks - heapBefore : 0;
+    stats.heapPeakBytes = heap.arena > arenaBefore ? heap.arena - arenaBefore : 0;
+    statsPending = true;
+
+    // Whatever the server gave us this time, a new ticket or the same id
+    altcp_tls_free_session(&session);
+    altcp_tls_init_session(&session);
+    if (altcp_tls_get_session(conn, &session) == ERR_OK) {
+        sessionValid = true;
+        sessionDirty = true;
+    }
+}
+
+bool tlsPersistSession(void) {
+    if (!sessionDirty) {
+        return true;
+    }
+
+    static TlsStoredSession fresh;
+    size_t length = 0;
+    cyw43_arch_lwip_begin();
+    sessionDirty = false;
+    const int err = mbedtls_ssl_session_save(&session.data, fresh.data, sizeof(fresh.data), &length);
+    cyw43_arch_lwip_end();
+    if (err != 0) {
+        return false;
+    }
+
+    fresh.length = length;
+    memset(&fresh.data[length], 0, sizeof(fresh.data) - length);
+    // Resuming by session id hands back the same session, spare the flash
+    if (memcmp(&fresh, &stored, sizeof(stored)) == 0) {
+        return true;
+    }
+    stored = fresh;
+    return storageSave(sessionSlot, TLS_SESSION_VERSION, &stored, sizeof(stored));
+}
+
+bool tlsTakeStats(TlsStats *out) {
+    if (!statsPending) {
+        return false;
+    }
+    statsPending = false;
+    *out = stats;
+    return true;
+}
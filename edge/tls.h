@@ -0,0 +1,42 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lwip/altcp_tls.h"
+
+// Bump when the stored session layout changes, stored records are then ignored
+#define TLS_SESSION_VERSION 1
+// Serialised session, enough for a ticket without the peer certificate
+#define TLS_SESSION_MAX_SIZE 1024
+
+// What the last connection cost, for the /tls report
+typedef struct TlsStats {
+    uint32_t connects;
+    uint32_t connectMs;     // TCP connect, handshake and MQTT CONNACK
+    uint32_t heapBytes;     // C heap still held once connected
+    uint32_t heapPeakBytes; // growth of the heap arena during the handshake
+    bool sessionOffered;    // a cached session was offered for resumption
+} TlsStats;
+
+// Loads the session stored in `storageSlot` and builds the client config
+// around the CA certificate. Returns NULL if the certificate does not parse.
+struct altcp_tls_config *tlsInit(const uint8_t *caCert, size_t caCertLen, uint8_t storageSlot);
+
+// Call right after the connect was started, in lwIP context. Sets the name
+// the certificate is checked against and offers the cached session.
+void tlsConnecting(struct altcp_pcb *conn, const char *hostname);
+
+// Call on CONNACK, in lwIP context. Takes the measurements and keeps the
+// session in RAM for the next reconnect.
+void tlsConnected(struct altcp_pcb *conn);
+
+// Writes the RAM session to flash if it changed since the last write.
+// Call from a task, not from lwIP context.
+bool tlsPersistSession(void);
+
+// Copy of the stats, true when there is a connection not reported yet
+bool tlsTakeStats(TlsStats *out);
+
+#endif //TLS_H
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Lookup tables for units.c, the analog sensors in engineering units.
+
+Usage: adc_lut.py <output header>
+
+Run by Cmake at build time. Each table is a list of integer (x, y) points
+with x ascending, units.c interpolates linearly between them, so the
+firmware needs neither floats nor pow(). Each table's header comment gives
+the worst error of that interpolation against the curve it samples.
+
+- light: ADC counts to lux for the ALS-PT19 on the ADA161 breakout. Its
+  photocurrent is linear in illuminance into the 10k load until the output
+  runs into the rail, readings past that are clamped.
+- gas: Rs/R0 (Q12) of the MQ-7 to ppm CO, the datasheet's sensitivity
+  curve as the usual power law fit, over the 20-2000 ppm it covers.
+- gas temperature: Rs(T)/Rs(20 C) (Q12) of the MQ-7 at 33 %RH, read off
+  the datasheet's temperature dependence figure, in centi-degrees.
+"""
+
+import math
+import sys
+
+ADC_COUNTS = 4095
+ADC_VREF_MV = 3300
+
+# ALS-PT19: about 0.2 uA per lux, 10k load, output saturates 0.4 V short of VCC
+PT19_UA_PER_LUX = 0.2
+PT19_LOAD_OHMS = 10000
+PT19_SATURATION_MV = ADC_VREF_MV - 400
+
+# MQ-7, ppm = A * (Rs/R0)^B with R0 the resistance in 100 ppm CO
+MQ7_A = 99.042
+MQ7_B = -1.518
+MQ7_MIN_PPM = 20
+MQ7_MAX_PPM = 2000
+MQ7_POINTS = 33
+
+# MQ-7 Rs(T)/Rs(20 C) at 33 %RH
+MQ7_TEMPERATURE = [
+    (-10, 1.12),
+    (0, 1.07),
+    (10, 1.03),
+    (20, 1.00),
+    (30, 0.97),
+    (40, 0.94),
+    (50, 0.91),
+]
+
+Q12 = 1 << 12
+
+
+def light_table():
+    mv_per_lux = PT19_UA_PER_LUX * PT19_LOAD_OHMS / 1000
+    saturation = round(PT19_SATURATION_MV * ADC_COUNTS / ADC_VREF_MV)
+    saturation_lux = round(PT19_SATURATION_MV / mv_per_lux)
+    points = [(0, 0), (saturation, saturation_lux), (ADC_COUNTS, saturation_lux)]
+    return points, lambda counts: min(counts, saturation) * ADC_VREF_MV / ADC_COUNTS / mv_per_lux
+
+
+def gas_table():
+    def ratio(ppm):
+        return (ppm / MQ7_A) ** (1 / MQ7_B)
+
+    def ppm(r):
+        return MQ7_A * r ** MQ7_B
+
+    # Evenly spaced in log(Rs/R0), where the curve is a straight line
+    low, high = ratio(MQ7_MAX_PPM), ratio(MQ7_MIN_PPM)
+    step = (high / low) ** (1 / (MQ7_POINTS - 1))
+    points = []
+    for i in range(MQ7_POINTS):
+        r = low * step ** i
+        x = round(r * Q12)
+        points.append((x, round(ppm(x / Q12))))
+    return points, lambda x: ppm(x / Q12)
+
+
+def temperature_table():
+    points = [(t * 100, round(f * Q12)) for t, f in MQ7_TEMPERATURE]
+    return points, None
+
+
+def interpolate(points, x):
+    for (x0, y0), (x1, y1) in zip(points, points[1:]):
+        if x0 <= x <= x1:
+            return y0 + (y1 - y0) * (x - x0) / (x1 - x0)
+    raise ValueError(x)
+
+
+def worst_error(points, exact):
+    """Largest relative error of the interpolation, in percent. On top of
+    it the firmware truncates to whole units."""
+    worst = 0.0
+    for x in range(points[0][0], points[-1][0] + 1):
+        want = exact(x)
+        if want >= 1:
+            worst = max(worst, abs(interpolate(points, x) - want) / want)
+    return worst * 100
+
+
+def emit(out, name, points, exact, unit):
+    error = "read off a figure" if exact is None else \
+        "worst interpolation error %.2f %%" % worst_error(points, exact)
+    out.write("// %s, %s\n" % (unit, error))
+    out.write("static const UnitsPoint %s[] = {\n" % name)
+    for x, y in points:
+        out.write("    { %d, %d },\n" % (x, y))
+    out.write("};\n\n")
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    with open(sys.argv[1], "w") as out:
+        out.write("// Generated by tools/adc_lut.py, do not edit\n\n")
+        out.write("#ifndef ADC_LUT_H\n#define ADC_LUT_H\n\n")
+        emit(out, "lightLux", *light_table(), "ADC counts to lux")
+        emit(out, "gasPpm", *gas_table(), "MQ-7 Rs/R0 (Q12) to ppm CO")
+        emit(out, "gasTemperature", *temperature_table(), "centi-degrees C to MQ-7 Rs(T)/Rs(20 C) (Q12)")
+        out.write("#endif //ADC_LUT_H\n")
+
+
+if __name__ == "__main__":
+    main()
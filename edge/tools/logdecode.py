@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Decodes the binary log frames written by edge/log.c.
+
+Usage: logdecode.py build/fogberry.elf [capture]
+
+Reads the UART stream from the capture file (stdin when omitted, e.g. a
+serial port set up with stty), passes plain text through and turns every
+frame back into a line of text using the format strings in the ELF.
+"""
+
+import re
+import struct
+import sys
+
+FRAME_START = 0xFF
+LEVELS = ("E", "W", "I", "D")
+SHF_ALLOC = 0x2
+SHT_PROGBITS = 1
+
+# printf conversions, length modifiers are dropped since every argument is
+# sent as 32 bits
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diouxXcsp%])")
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise ValueError("%s is not a 32 bit ELF file" % path)
+
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x2E)
+        headers = [struct.unpack_from("<IIIIIIIIII", self.data, shoff + i * shentsize) for i in range(shnum)]
+        names = headers[shstrndx][4]
+
+        # (name, address, file offset, size) of everything loaded on the device
+        self.sections = []
+        for name, kind, flags, addr, offset, size, *_ in headers:
+            if kind == SHT_PROGBITS and flags & SHF_ALLOC:
+                end = self.data.index(b"\0", names + name)
+                self.sections.append((self.data[names + name:end].decode(), addr, offset, size))
+        if not any(section[0] == ".fogberry_log" for section in self.sections):
+            raise ValueError("%s has no .fogberry_log section" % path)
+
+    def string_at(self, address):
+        for _, addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.index(b"\0", start)
+                return self.data[start:end].decode(errors="replace")
+        return None
+
+
+def format_record(elf, token, args):
+    if token == 0:
+        return "%d log records dropped" % args[0]
+    fmt = elf.string_at(token)
+    if fmt is None:
+        return "unknown token 0x%08x %s" % (token, args)
+
+    remaining = list(args)
+
+    def convert(match):
+        flags, _, kind = match.groups()
+        if kind == "%":
+            return "%"
+        if not remaining:
+            return "<missing>"
+        value = remaining.pop(0)
+        if kind == "s":
+            text = elf.string_at(value)
+            return ("%" + flags + "s") % (text if text is not None else "<0x%08x>" % value)
+        if kind in "di" and value & 0x80000000:
+            value -= 1 << 32
+        if kind == "p":
+            return "0x%08x" % value
+        if kind == "u":
+            kind = "d"
+        return ("%" + flags + kind) % value
+
+    return CONVERSION.sub(convert, fmt).rstrip("\n")
+
+
+def read_exact(stream, count):
+    data = stream.read(count)
+    return data if len(data) == count else None
+
+
+def decode(elf, stream, out):
+    text = bytearray()
+    while True:
+        byte = stream.read(1)
+        if not byte:
+            break
+        if byte[0] != FRAME_START:
+            text += byte
+            if byte == b"\n":
+                out.write(text.decode(errors="replace"))
+                text.clear()
+            continue
+
+        header = read_exact(stream, 9)
+        if header is None:
+            break
+        info, token, time_us = struct.unpack("<BII", header)
+        count = info >> 4
+        payload = read_exact(stream, 4 * count)
+        if payload is None:
+            break
+        args = struct.unpack("<%dI" % count, payload)
+        out.write("%10.6f %s core%d %s\n" % (time_us / 1e6, LEVELS[info & 3], (info >> 2) & 1,
+                                            format_record(elf, token, args)))
+        out.flush()
+    if text:
+        out.write(text.decode(errors="replace"))
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.stderr.write(__doc__)
+        return 2
+    elf = Elf(sys.argv[1])
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], "rb") as stream:
+            decode(elf, stream, sys.stdout)
+    else:
+        decode(elf, sys.stdin.buffer, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Stands in for an MQTT-SN gateway when testing builds with MQTT_SN=1.
+
+Usage: mqttsn_gateway.py [--port 1885] [--broker host] [--loss 0.2] [main.h]
+
+Answers CONNECT, PUBLISH and PINGREQ from edge/mqttsn.c. Predefined topic
+ids are looked up in the topic table of main.h (index plus one), so
+"/<client><name> <payload>" comes out the same as from mosquitto_sub -v.
+With --broker every publish is passed on with mosquitto_pub, so fog.sh
+works unchanged. --loss drops that share of datagrams in both directions
+to exercise retransmission. Retransmitted duplicates are acknowledged but
+only passed on once.
+"""
+
+import os
+import random
+import re
+import socket
+import struct
+import subprocess
+import sys
+
+CONNECT = 0x04
+CONNACK = 0x05
+PUBLISH = 0x0C
+PUBACK = 0x0D
+PINGREQ = 0x16
+PINGRESP = 0x17
+DISCONNECT = 0x18
+
+FLAG_DUP = 0x80
+TOPIC_PREDEFINED = 0x01
+ACCEPTED = 0x00
+REJECTED_INVALID_TOPIC = 0x02
+
+# Message ids remembered per client to spot duplicates
+RECENT_IDS = 64
+
+TOPIC_ENTRY = re.compile(r'X\((mainTOPIC_\w+),\s*"([^"]+)"\)')
+
+
+def load_topics(path):
+    with open(path) as f:
+        names = [name for _, name in TOPIC_ENTRY.findall(f.read())]
+    return {index + 1: name for index, name in enumerate(names)}
+
+
+class Gateway:
+    def __init__(self, port, topics, broker, loss):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(("", port))
+        self.topics = topics
+        self.broker = broker
+        self.loss = loss
+        self.clients = {}  # address -> client id
+        self.recent = {}   # address -> recently seen message ids
+
+    def lost(self):
+        return self.loss and random.random() < self.loss
+
+    def send(self, addr, kind, body=b""):
+        if self.lost():
+            print("(dropped %02x to %s)" % (kind, addr[0]))
+            return
+        self.sock.sendto(bytes((2 + len(body), kind)) + body, addr)
+
+    def forward(self, topic, payload):
+        print("%s %s" % (topic, payload.decode(errors="replace")), flush=True)
+        if self.broker:
+            subprocess.run(["mosquitto_pub", "-h", self.broker, "-q", "1", "-t", topic, "-m", payload],
+                           check=False)
+
+    def on_connect(self, addr, body):
+        client = body[4:].decode(errors="replace")
+        self.clients[addr] = client
+        self.recent[addr] = []
+        print("CONNECT %s from %s, keep alive %ds" % (client, addr[0], struct.unpack(">H", body[2:4])[0]))
+        self.send(addr, CONNACK, bytes((ACCEPTED,)))
+
+    def on_publish(self, addr, body):
+        flags = body[0]
+        topic_id, msg_id = struct.unpack(">HH", body[1:5])
+        payload = body[5:]
+        client = self.clients.get(addr)
+        name = self.topics.get(topic_id)
+        if client is None or flags & 0x03 != TOPIC_PREDEFINED or name is None:
+            self.send(addr, PUBACK, struct.pack(">HHB", topic_id, msg_id, REJECTED_INVALID_TOPIC))
+            return
+
+        recent = self.recent[addr]
+        if msg_id in recent:
+            print("(duplicate %d%s)" % (msg_id, ", DUP set" if flags & FLAG_DUP else ""))
+        else:
+            recent.append(msg_id)
+            del recent[:-RECENT_IDS]
+            self.forward("/%s%s" % (client, name), payload)
+        self.send(addr, PUBACK, struct.pack(">HHB", topic_id, msg_id, ACCEPTED))
+
+    def run(self):
+        while True:
+            packet, addr = self.sock.recvfrom(512)
+            if self.lost():
+                print("(dropped from %s)" % addr[0])
+                continue
+            if len(packet) < 2 or packet[0] != len(packet):
+                continue
+            kind, body = packet[1], packet[2:]
+            if kind == CONNECT and len(body) >= 4:
+                self.on_connect(addr, body)
+            elif kind == PUBLISH and len(body) >= 5:
+                self.on_publish(addr, body)
+            elif kind == PINGREQ:
+                self.send(addr, PINGRESP)
+            elif kind == DISCONNECT:
+                self.clients.pop(addr, None)
+                self.send(addr, DISCONNECT)
+
+
+def main():
+    args = sys.argv[1:]
+    port, broker, loss = 1885, None, 0.0
+    header = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "main.h")
+    try:
+        while args:
+            arg = args.pop(0)
+            if arg == "--port":
+                port = int(args.pop(0))
+            elif arg == "--broker":
+                broker = args.pop(0)
+            elif arg == "--loss":
+                loss = float(args.pop(0))
+            elif not arg.startswith("-"):
+                header = arg
+            else:
+                raise ValueError(arg)
+    except (IndexError, ValueError):
+        sys.stderr.write(__doc__)
+        return 2
+
+    topics = load_topics(header)
+    print("Listening on udp/%d with %d predefined topics" % (port, len(topics)))
+    Gateway(port, topics, broker, loss).run()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,33 @@
+#ifndef HARDWARE_GPIO_H
+#define HARDWARE_GPIO_H
+
+#include "pico.h"
+
+// Pins do nothing on the host, chip selects go through spibus.h
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+};
+
+static inline void gpio_init(uint gpio) {
+    (void) gpio;
+}
+
+static inline void gpio_set_dir(uint gpio, bool out) {
+    (void) gpio;
+    (void) out;
+}
+
+static inline void gpio_put(uint gpio, bool value) {
+    (void) gpio;
+    (void) value;
+}
+
+static inline void gpio_set_function(uint gpio, enum gpio_function fn) {
+    (void) gpio;
+    (void) fn;
+}
+
+#endif //HARDWARE_GPIO_H
@@ -0,0 +1,31 @@
+#ifndef HARDWARE_SPI_H
+#define HARDWARE_SPI_H
+
+#include "pico.h"
+
+// Two buses as on the RP2040, spihost.c keeps their baud rate to time the
+// transfers
+typedef struct spi_inst {
+    uint baudrate;
+} spi_inst_t;
+
+extern spi_inst_t spiHostInstances[2];
+#define spi0 (&spiHostInstances[0])
+#define spi1 (&spiHostInstances[1])
+
+typedef enum {
+    SPI_LSB_FIRST = 0,
+    SPI_MSB_FIRST = 1,
+} spi_order_t;
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+
+static inline void spi_set_format(spi_inst_t *spi, uint dataBits, int cpol, int cpha, spi_order_t order) {
+    (void) spi;
+    (void) dataBits;
+    (void) cpol;
+    (void) cpha;
+    (void) order;
+}
+
+#endif //HARDWARE_SPI_H
@@ -0,0 +1,15 @@
+#ifndef PICO_H
+#define PICO_H
+
+// The little of the Pico SDK the SPI drivers need, for building them on a
+// PC against the register models. Not a port of the SDK.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(name) name
+#define __unused __attribute__((unused))
+
+#endif //PICO_H
@@ -0,0 +1,13 @@
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+#include <stdio.h>
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+static inline void tight_loop_contents(void) {
+}
+
+#endif //PICO_STDLIB_H
@@ -0,0 +1,33 @@
+#ifndef PICO_TIME_H
+#define PICO_TIME_H
+
+#include "pico.h"
+
+// Time is the modelled clock of spihost.c. It moves with the bytes on the
+// bus, the devices' own latencies and sleeps, not with the PC's clock.
+typedef uint64_t absolute_time_t;
+
+uint64_t time_us_64(void);
+void sleep_us(uint64_t us);
+
+static inline uint32_t time_us_32(void) {
+    return (uint32_t) time_us_64();
+}
+
+static inline void sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t) ms * 1000);
+}
+
+static inline absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t) (to - from);
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t) (t / 1000);
+}
+
+#endif //PICO_TIME_H
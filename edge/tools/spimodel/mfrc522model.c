@@ -0,0 +1,440 @@
+#include "mfrc522model.h"
+
+#include <string.h>
+
+#include "mfrc522.h"
+
+// Register index from the driver's enum, which is the SPI address byte
+#define REG(name) ((name) >> 1)
+
+// ComIrqReg bits
+#define IRQ_TX 0x40
+#define IRQ_RX 0x20
+#define IRQ_IDLE 0x10
+#define IRQ_TIMER 0x01
+// DivIrqReg
+#define IRQ_CRC 0x04
+// Status2Reg
+#define STATUS2_CRYPTO1_ON 0x08
+// ErrorReg
+#define ERROR_BUFFER_OVFL 0x10
+
+// 106 kbit/s, 128 carrier cycles per bit
+#define BIT_NS 9440
+// PICC frame delay, 1236 carrier cycles after the end of the PCD frame
+#define FDT_US 91
+#define NAK 0x04
+
+static uint64_t airUs(uint8_t bytes, uint8_t lastBits) {
+    // Start and end of frame, 8 bits and parity per byte, the short frame
+    // of REQA and WUPA has 7 bits without parity
+    uint32_t bits = 2 + bytes * 9;
+    if (lastBits && bytes) {
+        bits -= 9 - lastBits;
+    }
+    return (uint64_t) bits * BIT_NS / 1000;
+}
+
+static uint64_t timerUs(const Mfrc522Model *model) {
+    const uint32_t prescaler = ((model->regs[REG(TModeReg)] & 0x0F) << 8) | model->regs[REG(TPrescalerReg)];
+    const uint32_t reload = (model->regs[REG(TReloadRegH)] << 8) | model->regs[REG(TReloadRegL)];
+    // f_timer = 13.56 MHz / (2 * TPrescaler + 1), section 8.5
+    return (uint64_t) (2 * prescaler + 1) * (reload + 1) * 100 / 1356;
+}
+
+static uint16_t crcA(const uint8_t *data, uint8_t length, uint16_t preset) {
+    uint16_t crc = preset;
+    for (uint8_t i = 0; i < length; i++) {
+        uint8_t ch = data[i] ^ (uint8_t) crc;
+        ch ^= (uint8_t) (ch << 4);
+        crc = (crc >> 8) ^ ((uint16_t) ch << 8) ^ ((uint16_t) ch << 3) ^ (ch >> 4);
+    }
+    return crc;
+}
+
+// Frames from the PCD end in CRC_A, the PICC ignores those where it is wrong
+static bool crcOk(const uint8_t *frame, uint8_t length) {
+    const uint16_t crc = crcA(frame, length - 2, 0x6363);
+    return frame[length - 2] == (crc & 0xFF) && frame[length - 1] == (crc >> 8);
+}
+
+static void appendCrc(uint8_t *frame, uint8_t length) {
+    const uint16_t crc = crcA(frame, length, 0x6363);
+    frame[length] = crc & 0xFF;
+    frame[length + 1] = crc >> 8;
+}
+
+static bool antennaOn(const Mfrc522Model *model) {
+    return (model->regs[REG(TxControlReg)] & 0x03) == 0x03;
+}
+
+static void dropCrypto(Mfrc522Model *model) {
+    model->authSector = -1;
+    model->regs[REG(Status2Reg)] &= ~STATUS2_CRYPTO1_ON;
+}
+
+static void reset(Mfrc522Model *model) {
+    // Reset values of section 9.3, for the registers the driver reads back
+    memset(model->regs, 0, sizeof(model->regs));
+    model->regs[REG(CommandReg)] = 0x20;
+    model->regs[REG(ComIrqReg)] = 0x14;
+    model->regs[REG(ControlReg)] = 0x10;
+    model->regs[REG(ModeReg)] = 0x3F;
+    model->regs[REG(TxControlReg)] = 0x80;
+    model->regs[REG(VersionReg)] = 0x92;
+    model->fifoLevel = 0;
+    model->pending = false;
+    // The antenna is off after a reset, a card in the field loses power
+    model->state = MFRC522_CARD_IDLE;
+    dropCrypto(model);
+}
+
+// Delivers a Transceive or MFAuthent result once its time has come
+static void complete(Mfrc522Model *model) {
+    if (!model->pending || time_us_64() < model->pendingAtUs) {
+        return;
+    }
+    model->pending = false;
+    memcpy(model->fifo, model->response, model->responseLength);
+    model->fifoLevel = model->responseLength;
+    model->regs[REG(ControlReg)] = (model->regs[REG(ControlReg)] & ~0x07) | model->responseLastBits;
+    model->regs[REG(ComIrqReg)] |= model->pendingIrq;
+}
+
+static void respond(Mfrc522Model *model, const uint8_t *data, uint8_t length, uint8_t lastBits) {
+    memcpy(model->response, data, length);
+    model->responseLength = length;
+    model->responseLastBits = lastBits;
+}
+
+static bool answerSelect(Mfrc522Model *model, const uint8_t *frame, uint8_t length) {
+    const Mfrc522Card *card = model->card;
+    // Single size UIDs only, cascade level 1
+    if (length < 2 || frame[0] != PICC_CMD_SEL_CL1) {
+        return false;
+    }
+    uint8_t uidBcc[5];
+    memcpy(uidBcc, card->uid, 4);
+    uidBcc[4] = card->uid[0] ^ card->uid[1] ^ card->uid[2] ^ card->uid[3];
+
+    const uint8_t nvb = frame[1];
+    if (nvb == 0x70) {
+        if (length != 9 || !crcOk(frame, length) || memcmp(&frame[2], uidBcc, 5) != 0) {
+            return false;
+        }
+        uint8_t sak[3] = { card->sak };
+        appendCrc(sak, 1);
+        respond(model, sak, sizeof(sak), 0);
+        model->state = MFRC522_CARD_ACTIVE;
+        dropCrypto(model);
+        return true;
+    }
+
+    // ANTICOLLISION, the card sends the UID bytes not given and the BCC.
+    // With one card there are no collisions and no partial bytes.
+    const uint8_t known = (nvb >> 4) - 2;
+    if ((nvb & 0x0F) || known > 4 || length != 2 + known || memcmp(&frame[2], uidBcc, known) != 0) {
+        return false;
+    }
+    respond(model, &uidBcc[known], 5 - known, 0);
+    return true;
+}
+
+static bool answerActive(Mfrc522Model *model, const uint8_t *frame, uint8_t length) {
+    if (length < 3 || !crcOk(frame, length)) {
+        return false;
+    }
+    switch (frame[0]) {
+    case PICC_CMD_HLTA:
+        // Not answered, the driver takes the timeout as success
+        if (length == 4 && frame[1] == 0) {
+            model->state = MFRC522_CARD_HALT;
+            dropCrypto(model);
+            return false;
+        }
+        break;
+    case PICC_CMD_MF_READ:
+        if (length == 4 && frame[1] < MFRC522_MODEL_BLOCKS && model->authSector == frame[1] / 4) {
+            uint8_t data[18];
+            memcpy(data, model->card->blocks[frame[1]], 16);
+            if (frame[1] % 4 == 3) {
+                // Key A never reads back
+                memset(data, 0, 6);
+            }
+            appendCrc(data, 16);
+            respond(model, data, sizeof(data), 0);
+            return true;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // Anything else gets a NAK and sends the card back to IDLE
+    const uint8_t nak = NAK;
+    respond(model, &nak, 1, 4);
+    model->state = MFRC522_CARD_IDLE;
+    dropCrypto(model);
+    return true;
+}
+
+static bool answer(Mfrc522Model *model, const uint8_t *frame, uint8_t length, uint8_t lastBits) {
+    if (!model->card || !antennaOn(model) || length == 0) {
+        return false;
+    }
+    // REQA and WUPA, short frames
+    if (length == 1 && lastBits == 7) {
+        const bool wakes = (frame[0] == PICC_CMD_REQA && model->state == MFRC522_CARD_IDLE) ||
+                           (frame[0] == PICC_CMD_WUPA && (model->state == MFRC522_CARD_IDLE ||
+                                                           model->state == MFRC522_CARD_HALT));
+        if (!wakes) {
+            return false;
+        }
+        model->state = MFRC522_CARD_READY;
+        respond(model, model->card->atqa, 2, 0);
+        return true;
+    }
+    if (lastBits) {
+        return false;
+    }
+    switch (model->state) {
+    case MFRC522_CARD_READY:
+        return answerSelect(model, frame, length);
+    case MFRC522_CARD_ACTIVE:
+        return answerActive(model, frame, length);
+    default:
+        return false;
+    }
+}
+
+static void transceive(Mfrc522Model *model) {
+    const uint8_t lastBits = model->regs[REG(BitFramingReg)] & 0x07;
+    uint8_t frame[sizeof(model->fifo)];
+    const uint8_t length = model->fifoLevel;
+    memcpy(frame, model->fifo, length);
+    model->fifoLevel = 0;
+    model->regs[REG(ErrorReg)] = 0;
+
+    const uint64_t sentUs = time_us_64() + airUs(length, lastBits);
+    model->responseLength = 0;
+    model->responseLastBits = 0;
+    if (answer(model, frame, length, lastBits)) {
+        model->pendingAtUs = sentUs + FDT_US + airUs(model->responseLength, model->responseLastBits);
+        model->pendingIrq = IRQ_TX | IRQ_RX;
+    } else {
+        // TAuto starts the timer at the end of the transmission
+        model->pendingAtUs = sentUs + timerUs(model);
+        model->pendingIrq = IRQ_TX | IRQ_TIMER;
+    }
+    model->pending = true;
+}
+
+// Three pass authentication: AUTH, nonce, reader nonce and answer, answer
+static void authenticate(Mfrc522Model *model) {
+    const uint8_t *fifo = model->fifo;
+    const Mfrc522Card *card = model->card;
+    bool ok = model->fifoLevel == 12 && card && antennaOn(model) &&
+              model->state == MFRC522_CARD_ACTIVE && fifo[1] < MFRC522_MODEL_BLOCKS &&
+              memcmp(&fifo[8], card->uid, 4) == 0;
+    if (ok) {
+        const uint8_t *trailer = card->blocks[fifo[1] / 4 * 4 + 3];
+        if (fifo[0] == PICC_CMD_MF_AUTH_KEY_A) {
+            ok = memcmp(&fifo[2], trailer, 6) == 0;
+        } else {
+            ok = fifo[0] == PICC_CMD_MF_AUTH_KEY_B && memcmp(&fifo[2], &trailer[10], 6) == 0;
+        }
+    }
+    const uint8_t sector = fifo[1] / 4;
+    model->fifoLevel = 0;
+    model->authentications++;
+    model->responseLength = 0;
+    model->responseLastBits = 0;
+
+    const uint64_t nonceUs = airUs(4, 0) + FDT_US + airUs(4, 0);
+    if (ok) {
+        model->authSector = sector;
+        model->regs[REG(Status2Reg)] |= STATUS2_CRYPTO1_ON;
+        model->pendingAtUs = time_us_64() + nonceUs + airUs(8, 0) + FDT_US + airUs(4, 0);
+        model->pendingIrq = IRQ_IDLE;
+    } else {
+        // A wrong key goes unanswered and the card drops back to IDLE
+        model->state = MFRC522_CARD_IDLE;
+        dropCrypto(model);
+        model->pendingAtUs = time_us_64() + nonceUs + airUs(8, 0) + timerUs(model);
+        model->pendingIrq = IRQ_TIMER;
+    }
+    model->pending = true;
+}
+
+static void command(Mfrc522Model *model, uint8_t value) {
+    const uint8_t cmd = value & 0x0F;
+    model->regs[REG(CommandReg)] = (model->regs[REG(CommandReg)] & 0x20) | (value & 0x1F);
+    switch (cmd) {
+    case PCD_Idle:
+        model->pending = false;
+        break;
+    case PCD_CalcCRC: {
+        // CRCPreset in ModeReg[1..0]
+        static const uint16_t presets[] = { 0x0000, 0x6363, 0xA671, 0xFFFF };
+        const uint16_t crc = crcA(model->fifo, model->fifoLevel, presets[model->regs[REG(ModeReg)] & 0x03]);
+        model->fifoLevel = 0;
+        model->regs[REG(CRCResultRegL)] = crc & 0xFF;
+        model->regs[REG(CRCResultRegH)] = crc >> 8;
+        model->regs[REG(DivIrqReg)] |= IRQ_CRC;
+        break;
+    }
+    case PCD_MFAuthent:
+        authenticate(model);
+        break;
+    case PCD_SoftReset:
+        reset(model);
+        break;
+    default:
+        // Transceive waits for StartSend
+        break;
+    }
+}
+
+static uint8_t readRegister(Mfrc522Model *model, uint8_t reg) {
+    switch (reg) {
+    case REG(FIFODataReg): {
+        if (!model->fifoLevel) {
+            return 0;
+        }
+        const uint8_t value = model->fifo[0];
+        memmove(model->fifo, &model->fifo[1], --model->fifoLevel);
+        return value;
+    }
+    case REG(FIFOLevelReg):
+        return model->fifoLevel;
+    default:
+        return model->regs[reg];
+    }
+}
+
+static void writeRegister(Mfrc522Model *model, uint8_t reg, uint8_t value) {
+    switch (reg) {
+    case REG(CommandReg):
+        command(model, value);
+        break;
+    case REG(ComIrqReg):
+    case REG(DivIrqReg):
+        // Set1 and Set2 set the marked bits, without them they are cleared
+        if (value & 0x80) {
+            model->regs[reg] |= value & 0x7F;
+        } else {
+            model->regs[reg] &= ~value;
+        }
+        break;
+    case REG(FIFODataReg):
+        if (model->fifoLevel < sizeof(model->fifo)) {
+            model->fifo[model->fifoLevel++] = value;
+        } else {
+            model->regs[REG(ErrorReg)] |= ERROR_BUFFER_OVFL;
+        }
+        break;
+    case REG(FIFOLevelReg):
+        if (value & 0x80) {
+            model->fifoLevel = 0;
+            model->regs[REG(ErrorReg)] &= ~ERROR_BUFFER_OVFL;
+        }
+        break;
+    case REG(BitFramingReg):
+        model->regs[reg] = value & 0x7F;
+        if ((value & 0x80) && (model->regs[REG(CommandReg)] & 0x0F) == PCD_Transceive) {
+            transceive(model);
+        }
+        break;
+    case REG(Status2Reg):
+        model->regs[reg] = value;
+        if (!(value & STATUS2_CRYPTO1_ON)) {
+            dropCrypto(model);
+        }
+        break;
+    case REG(ErrorReg):
+    case REG(Status1Reg):
+    case REG(CRCResultRegH):
+    case REG(CRCResultRegL):
+    case REG(VersionReg):
+        break;
+    default:
+        model->regs[reg] = value;
+        break;
+    }
+}
+
+static void chipSelected(void *state) {
+    Mfrc522Model *model = state;
+    model->addressed = false;
+    complete(model);
+}
+
+// Section 8.1.2: the first byte is the address, read when bit 7 is set.
+// While reading each byte out is the next address and the byte in is the
+// register addressed before, writes go on to the same register.
+static uint8_t transfer(void *state, uint8_t mosi) {
+    Mfrc522Model *model = state;
+    if (!model->addressed) {
+        model->addressed = true;
+        model->reading = mosi & 0x80;
+        model->address = (mosi >> 1) & 0x3F;
+        return 0;
+    }
+    if (model->reading) {
+        const uint8_t value = readRegister(model, model->address);
+        model->address = (mosi >> 1) & 0x3F;
+        return value;
+    }
+    writeRegister(model, model->address, mosi);
+    return 0;
+}
+
+void mfrc522CardInit(Mfrc522Card *card, const uint8_t uid[4]) {
+    static const uint8_t factoryKey[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    static const uint8_t accessBits[4] = { 0xFF, 0x07, 0x80, 0x69 };
+
+    memcpy(card->uid, uid, 4);
+    card->sak = 0x08;
+    card->atqa[0] = 0x04;
+    card->atqa[1] = 0x00;
+    for (uint8_t block = 0; block < MFRC522_MODEL_BLOCKS; block++) {
+        for (uint8_t i = 0; i < 16; i++) {
+            card->blocks[block][i] = (uint8_t) (block * 16 + i);
+        }
+    }
+    // Manufacturer block
+    memcpy(card->blocks[0], uid, 4);
+    card->blocks[0][4] = uid[0] ^ uid[1] ^ uid[2] ^ uid[3];
+    card->blocks[0][5] = card->sak;
+    card->blocks[0][6] = card->atqa[0];
+    card->blocks[0][7] = card->atqa[1];
+    for (uint8_t sector = 0; sector < MFRC522_MODEL_BLOCKS / 4; sector++) {
+        uint8_t *trailer = card->blocks[sector * 4 + 3];
+        memcpy(trailer, factoryKey, 6);
+        memcpy(&trailer[6], accessBits, 4);
+        memcpy(&trailer[10], factoryKey, 6);
+    }
+}
+
+void mfrc522CardSetKeyA(Mfrc522Card *card, uint8_t sector, const uint8_t key[6]) {
+    memcpy(card->blocks[sector * 4 + 3], key, 6);
+}
+
+void mfrc522ModelInit(Mfrc522Model *model, uint cs) {
+    memset(model, 0, sizeof(*model));
+    model->device = (SpiDevice) {
+        .name = "mfrc522",
+        .cs = cs,
+        .state = model,
+        .select = chipSelected,
+        .transfer = transfer,
+    };
+    reset(model);
+    spiHostAttach(&model->device);
+}
+
+void mfrc522ModelInsert(Mfrc522Model *model, Mfrc522Card *card) {
+    model->card = card;
+    model->state = MFRC522_CARD_IDLE;
+    dropCrypto(model);
+}
@@ -0,0 +1,65 @@
+#ifndef MFRC522MODEL_H
+#define MFRC522MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "spihost.h"
+
+// Register level model of the MFRC522 and of one MIFARE Classic 1K in its
+// field, enough for what mfrc522.c does: the SPI framing of section 8.1.2,
+// the FIFO, the ComIrq/DivIrq bits, the CRC coprocessor, Transceive and
+// MFAuthent, the timer and soft reset. The card goes through IDLE, READY,
+// ACTIVE and HALT and answers REQA, WUPA, anticollision, SELECT, HLTA and
+// READ. Air time is ISO 14443A at 106 kbit/s, so the driver sees the
+// IRQ bits as late as it would on the bench and polls as often.
+#define MFRC522_MODEL_BLOCKS 64
+
+typedef struct Mfrc522Card {
+    uint8_t uid[4];
+    uint8_t sak;
+    uint8_t atqa[2];
+    // Sector trailers hold key A, the access bits and key B as on a card
+    uint8_t blocks[MFRC522_MODEL_BLOCKS][16];
+} Mfrc522Card;
+
+typedef enum Mfrc522CardState {
+    MFRC522_CARD_IDLE,
+    MFRC522_CARD_READY,
+    MFRC522_CARD_ACTIVE,
+    MFRC522_CARD_HALT,
+} Mfrc522CardState;
+
+typedef struct Mfrc522Model {
+    SpiDevice device;
+    uint8_t regs[64];
+    uint8_t fifo[64];
+    uint8_t fifoLevel;
+    // SPI frame
+    bool addressed;
+    bool reading;
+    uint8_t address;
+    // Transceive or MFAuthent under way
+    bool pending;
+    uint64_t pendingAtUs;
+    uint8_t pendingIrq;
+    uint8_t response[18];
+    uint8_t responseLength;
+    uint8_t responseLastBits;
+    // Card
+    Mfrc522Card *card;
+    Mfrc522CardState state;
+    int8_t authSector;          // -1 without Crypto1
+    uint32_t authentications;
+} Mfrc522Model;
+
+// Blank card: pattern data, factory keys FFFFFFFFFFFF and access bits
+void mfrc522CardInit(Mfrc522Card *card, const uint8_t uid[4]);
+void mfrc522CardSetKeyA(Mfrc522Card *card, uint8_t sector, const uint8_t key[6]);
+
+// Chip on chip select cs, attached to spihost
+void mfrc522ModelInit(Mfrc522Model *model, uint cs);
+// Into the field, NULL takes it out
+void mfrc522ModelInsert(Mfrc522Model *model, Mfrc522Card *card);
+
+#endif //MFRC522MODEL_H
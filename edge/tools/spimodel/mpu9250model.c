@@ -0,0 +1,65 @@
+#include "mpu9250model.h"
+
+#include <string.h>
+
+#define REG_ACCEL_XOUT_H 0x3B
+#define REG_TEMP_OUT_H 0x41
+#define REG_GYRO_XOUT_H 0x43
+#define REG_GYRO_ZOUT_L 0x48
+#define REG_PWR_MGMT_1 0x6B
+#define REG_WHO_AM_I 0x75
+
+static void putBigEndian(uint8_t *regs, const int16_t *values, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        regs[i * 2] = (uint8_t) ((uint16_t) values[i] >> 8);
+        regs[i * 2 + 1] = (uint8_t) values[i];
+    }
+}
+
+static void chipSelected(void *state) {
+    Mpu9250Model *model = state;
+    model->addressed = false;
+}
+
+// The first byte is the register, read when bit 7 is set. The address goes
+// up by one for each byte after it, reading or writing.
+static uint8_t transfer(void *state, uint8_t mosi) {
+    Mpu9250Model *model = state;
+    if (!model->addressed) {
+        model->addressed = true;
+        model->reading = mosi & 0x80;
+        model->address = mosi & 0x7F;
+        return 0;
+    }
+    const uint8_t reg = model->address;
+    model->address = (model->address + 1) & 0x7F;
+    if (model->reading) {
+        return model->regs[reg];
+    }
+    // Output registers and WHO_AM_I are read only
+    if ((reg < REG_ACCEL_XOUT_H || reg > REG_GYRO_ZOUT_L) && reg != REG_WHO_AM_I) {
+        model->regs[reg] = mosi;
+    }
+    return 0;
+}
+
+void mpu9250ModelInit(Mpu9250Model *model, uint cs) {
+    memset(model, 0, sizeof(*model));
+    model->device = (SpiDevice) {
+        .name = "mpu9250",
+        .cs = cs,
+        .state = model,
+        .select = chipSelected,
+        .transfer = transfer,
+    };
+    // Reset values, asleep until PWR_MGMT_1 is written
+    model->regs[REG_PWR_MGMT_1] = 0x01;
+    model->regs[REG_WHO_AM_I] = 0x71;
+    spiHostAttach(&model->device);
+}
+
+void mpu9250ModelSample(Mpu9250Model *model, const int16_t accel[3], int16_t temp, const int16_t gyro[3]) {
+    putBigEndian(&model->regs[REG_ACCEL_XOUT_H], accel, 3);
+    putBigEndian(&model->regs[REG_TEMP_OUT_H], &temp, 1);
+    putBigEndian(&model->regs[REG_GYRO_XOUT_H], gyro, 3);
+}
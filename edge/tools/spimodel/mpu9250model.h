@@ -0,0 +1,24 @@
+#ifndef MPU9250MODEL_H
+#define MPU9250MODEL_H
+
+#include <stdint.h>
+
+#include "spihost.h"
+
+// Register level model of the MPU9250 on SPI: WHO_AM_I, PWR_MGMT_1 and the
+// accel, temperature and gyro output registers, with the address going up
+// through a burst as on the chip. mpu9250.c reads the output registers
+// only, the FIFO and the AK8963 behind the I2C master are left out.
+typedef struct Mpu9250Model {
+    SpiDevice device;
+    uint8_t regs[128];
+    bool addressed;
+    bool reading;
+    uint8_t address;
+} Mpu9250Model;
+
+void mpu9250ModelInit(Mpu9250Model *model, uint cs);
+// What the next reads of the output registers return
+void mpu9250ModelSample(Mpu9250Model *model, const int16_t accel[3], int16_t temp, const int16_t gyro[3]);
+
+#endif //MPU9250MODEL_H
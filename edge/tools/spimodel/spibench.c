@@ -0,0 +1,205 @@
+// Runs the SPI drivers on a PC against the register models and counts what
+// each operation puts on the bus: chip select frames, bytes, the time the
+// bytes take at the driver's clock rate and the time the operation takes
+// with the chips' own latencies. Chip select frames are what to drive
+// down, each costs a few microseconds of setup on top of its bytes.
+// Each operation also checks the data it got back. Exits with 1 when
+// one of them did not.
+//
+//   cmake -S tools/spimodel -B build-spimodel && cmake --build build-spimodel
+//   build-spimodel/spibench
+
+#include <stdio.h>
+#include <string.h>
+
+#include "spihost.h"
+#include "mfrc522model.h"
+#include "mpu9250model.h"
+#include "mfrc522.h"
+#include "mpu9250.h"
+
+// Wiring of main.h, the entrance reader and the IMU
+#define BENCH_READER_CS 17
+#define BENCH_IMU_CS 13
+// rfid.c polls every RFID_POLL_MS
+#define BENCH_POLL_MS 2
+
+typedef struct BenchOp {
+    const char *name;
+    bool (*run)(void);
+} BenchOp;
+
+static Mfrc522Model readerModel;
+static Mfrc522Card card;
+static MFRC522Ptr_t reader;
+static Mpu9250Model imuModel;
+static MPU9250 imu;
+
+// Badge blocks and keys of main.h, sector 2 opened by the MAD key
+static const uint8_t badgeBlocks[] = { 4, 5, 6, 8, 9, 10 };
+static const MIFARE_Key badgeKeys[] = {
+    { { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF } },
+    { { 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5 } },
+};
+#define BADGE_BLOCKS (sizeof(badgeBlocks) / sizeof(badgeBlocks[0]))
+#define BADGE_KEYS (sizeof(badgeKeys) / sizeof(badgeKeys[0]))
+
+static const int16_t sampleAccel[3] = { 120, -340, 16384 };
+static const int16_t sampleGyro[3] = { -7, 3, 12 };
+
+static char note[64];
+
+static bool badgeMatches(const uint8_t *data) {
+    for (size_t i = 0; i < BADGE_BLOCKS; i++) {
+        if (memcmp(&data[i * 16], card.blocks[badgeBlocks[i]], 16) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool readBadge(bool batched, bool cached) {
+    uint8_t data[BADGE_BLOCKS * 16];
+    MIFARE_ReadStats_t stats;
+    if (!cached) {
+        memset(reader->keyCache, 0, sizeof(reader->keyCache));
+    }
+    const StatusCode status = batched
+        ? MIFARE_ReadBlocks(reader, &reader->uid, badgeBlocks, BADGE_BLOCKS, badgeKeys, BADGE_KEYS, data, &stats)
+        : MIFARE_ReadBlocksOneByOne(reader, &reader->uid, badgeBlocks, BADGE_BLOCKS, badgeKeys, BADGE_KEYS, data, &stats);
+    snprintf(note, sizeof(note), "%u auths, %u key retries", stats.auths, stats.keyRetries);
+    return status == STATUS_OK && badgeMatches(data);
+}
+
+static bool pcdInit(void) {
+    PCD_Init(reader);
+    return PCD_IsPresent(reader);
+}
+
+static bool requestEmptyField(void) {
+    return !PICC_IsNewCardPresent(reader);
+}
+
+static bool requestCard(void) {
+    return PICC_IsNewCardPresent(reader);
+}
+
+static bool selectCard(void) {
+    return PICC_ReadCardSerial(reader) && reader->uid.size == 4 &&
+           memcmp(reader->uid.uidByte, card.uid, 4) == 0;
+}
+
+static bool readOneByOne(void) {
+    return readBadge(false, false);
+}
+
+static bool readPerSector(void) {
+    return readBadge(true, false);
+}
+
+static bool readPerSectorCached(void) {
+    return readBadge(true, true);
+}
+
+static bool haltCard(void) {
+    const bool halted = PICC_HaltA(reader) == STATUS_OK;
+    PCD_StopCrypto1(reader);
+    return halted;
+}
+
+// What rfid.c does for one reader: REQA, then a look every poll period
+static bool pollHaltedCard(void) {
+    PICC_StartRequestA(reader);
+    StatusCode status;
+    uint32_t polls = 0;
+    while ((status = PICC_PollRequestA(reader)) == STATUS_BUSY) {
+        sleep_ms(BENCH_POLL_MS);
+        polls++;
+    }
+    snprintf(note, sizeof(note), "%lu polls", (unsigned long) polls);
+    // A halted card only answers WUPA
+    return status == STATUS_TIMEOUT;
+}
+
+static bool imuStart(void) {
+    return mpu9250Start(&imu);
+}
+
+static bool imuReadAccel(void) {
+    mpu9250ReadAccel(&imu);
+    return memcmp(imu.accel, sampleAccel, sizeof(sampleAccel)) == 0;
+}
+
+static bool imuRead(void) {
+    mpu9250Read(&imu);
+    return memcmp(imu.gyro, sampleGyro, sizeof(sampleGyro)) == 0;
+}
+
+static const BenchOp mfrc522Ops[] = {
+    { "PCD_Init + PCD_IsPresent", pcdInit },
+    { "PICC_IsNewCardPresent, no card", requestEmptyField },
+};
+
+static const BenchOp cardOps[] = {
+    { "PICC_IsNewCardPresent", requestCard },
+    { "PICC_ReadCardSerial", selectCard },
+    { "6 blocks, MIFARE_ReadBlocksOneByOne", readOneByOne },
+    { "6 blocks, MIFARE_ReadBlocks", readPerSector },
+    { "6 blocks, MIFARE_ReadBlocks cached", readPerSectorCached },
+    { "PICC_HaltA + PCD_StopCrypto1", haltCard },
+    { "REQA polled, halted card", pollHaltedCard },
+};
+
+static const BenchOp mpu9250Ops[] = {
+    { "mpu9250Start", imuStart },
+    { "mpu9250ReadAccel", imuReadAccel },
+    { "mpu9250Read", imuRead },
+};
+
+static bool run(const BenchOp *ops, size_t count) {
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        SpiCounters bus;
+        note[0] = '\0';
+        spiHostResetCounters();
+        const uint64_t start = time_us_64();
+        const bool passed = ops[i].run();
+        const uint64_t elapsed = time_us_64() - start;
+        spiHostCounters(&bus);
+        printf("%-38s %6lu %7lu %9.1f %10llu  %s%s\n", ops[i].name,
+               (unsigned long) bus.transactions, (unsigned long) bus.bytes,
+               bus.busNs / 1000.0, (unsigned long long) elapsed,
+               passed ? "" : "FAILED ", note);
+        ok &= passed;
+    }
+    return ok;
+}
+
+int main(void) {
+    static const uint8_t uid[4] = { 0x22, 0x41, 0xCC, 0x10 };
+    static const uint8_t madKey[6] = { 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5 };
+    const MFRC522Config_t readerConfig = {
+        .spi = spi0, .sckPin = 18, .mosiPin = 19, .misoPin = 16,
+        .csPin = BENCH_READER_CS, .resetPin = 20, .baudrate = 1000000,
+    };
+    const MPU9250Desc imuDesc = {
+        .pinMISO = 12, .pinCS = BENCH_IMU_CS, .pinSCK = 14, .pinMOSI = 15,
+        .spiPort = spi1,
+    };
+
+    mfrc522ModelInit(&readerModel, BENCH_READER_CS);
+    mfrc522CardInit(&card, uid);
+    mfrc522CardSetKeyA(&card, 2, madKey);
+    mpu9250ModelInit(&imuModel, BENCH_IMU_CS);
+    mpu9250ModelSample(&imuModel, sampleAccel, 2000, sampleGyro);
+
+    reader = MFRC522_InitWithConfig(&readerConfig);
+    imu = mpu9250Init(&imuDesc);
+
+    printf("%-38s %6s %7s %9s %10s\n", "operation", "frames", "bytes", "bus us", "total us");
+    bool ok = run(mfrc522Ops, sizeof(mfrc522Ops) / sizeof(mfrc522Ops[0]));
+    mfrc522ModelInsert(&readerModel, &card);
+    ok &= run(cardOps, sizeof(cardOps) / sizeof(cardOps[0]));
+    ok &= run(mpu9250Ops, sizeof(mpu9250Ops) / sizeof(mpu9250Ops[0]));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+#include "spihost.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pico/time.h"
+#include "spibus.h"
+
+#define SPIHOST_MAX_DEVICES 4
+
+spi_inst_t spiHostInstances[2];
+
+static SpiDevice *devices[SPIHOST_MAX_DEVICES];
+static uint8_t deviceCount;
+static SpiDevice *selected;
+static SpiCounters counters;
+static uint64_t nowNs;
+
+void spiHostAttach(SpiDevice *device) {
+    if (deviceCount == SPIHOST_MAX_DEVICES) {
+        fprintf(stderr, "spihost: no room for %s\n", device->name);
+        exit(2);
+    }
+    devices[deviceCount++] = device;
+}
+
+void spiHostCounters(SpiCounters *out) {
+    *out = counters;
+}
+
+void spiHostResetCounters(void) {
+    counters = (SpiCounters) { 0 };
+}
+
+void spiHostAdvanceNs(uint64_t ns) {
+    nowNs += ns;
+}
+
+uint64_t time_us_64(void) {
+    return nowNs / 1000;
+}
+
+void sleep_us(uint64_t us) {
+    nowNs += us * 1000;
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    spi->baudrate = baudrate;
+    return baudrate;
+}
+
+void spiBusSelect(uint cs) {
+    selected = NULL;
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        if (devices[i]->cs == cs) {
+            selected = devices[i];
+        }
+    }
+    // Nothing answers on a pin without a model, MISO idles high
+    counters.transactions++;
+    if (selected) {
+        selected->select(selected->state);
+    }
+}
+
+void spiBusDeselect(uint cs) {
+    (void) cs;
+    selected = NULL;
+}
+
+static uint8_t transfer(spi_inst_t *spi, uint8_t mosi) {
+    if (!spi->baudrate) {
+        fprintf(stderr, "spihost: transfer before spi_init\n");
+        exit(2);
+    }
+    counters.bytes++;
+    const uint64_t ns = 8000000000ull / spi->baudrate;
+    counters.busNs += ns;
+    nowNs += ns;
+    return selected ? selected->transfer(selected->state, mosi) : 0xFF;
+}
+
+void spiBusWrite(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        transfer(spi, src[i]);
+    }
+}
+
+void spiBusRead(spi_inst_t *spi, uint8_t repeatedTx, uint8_t *dst, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = transfer(spi, repeatedTx);
+    }
+}
+
+void spiBusWriteRead(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = transfer(spi, src[i]);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef SPIHOST_H
+#define SPIHOST_H
+
+#include <stdint.h>
+
+#include "pico.h"
+#include "hardware/spi.h"
+
+// The host side of spibus.h: routes each transaction to the device model
+// on its chip select, counts the traffic and keeps the modelled clock.
+// Bytes take 8 bit times at the rate the driver gave spi_init.
+typedef struct SpiDevice {
+    const char *name;
+    uint cs;
+    void *state;
+    void (*select)(void *state);
+    // One byte each way, MOSI in and MISO out
+    uint8_t (*transfer)(void *state, uint8_t mosi);
+} SpiDevice;
+
+typedef struct SpiCounters {
+    uint32_t transactions;      // chip select frames
+    uint32_t bytes;
+    uint64_t busNs;             // clocking the bytes
+} SpiCounters;
+
+void spiHostAttach(SpiDevice *device);
+void spiHostCounters(SpiCounters *out);
+void spiHostResetCounters(void);
+
+// Moves the clock on, for device latencies
+void spiHostAdvanceNs(uint64_t ns);
+
+#endif //SPIHOST_H
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""Worst case stack depth of every task from the static call graph.
+
+Usage: stack_usage.py [--margin 64] [--indirect 256] [--external 32]
+                      [--printf 512] [--strict] [-v]
+                      <build dir> [main.h] [FreeRTOSConfig.h]
+
+Reads the .ci call graphs GCC writes next to each object with
+-fstack-usage -fcallgraph-info=su (STACK_CHECK=1 in Cmake). It walks the
+graph from each task entry point in the stack table of main.h, plus the
+kernel's timer and idle tasks, and sums the frames along the deepest
+chain. Each task is charged --margin bytes on top for the exception frame
+and the context the port saves on the task stack. The totals are compared
+with what the task is created with. Exits with 1 when any task does not fit.
+
+The SDK links printf, snprintf, puts and the like with --wrap, so calls
+to them are followed into their __wrap_ definitions.
+
+Some chains are only partly known:
+- indirect calls are charged --indirect bytes
+- the printf family without a call graph is charged --printf bytes, the
+  SDK's formatter with long long and float support needs about that
+- calls into other code without a call graph (libc, libgcc, the boot ROM)
+  are charged --external bytes
+- recursion is counted once
+- unbounded dynamic frames (VLAs, alloca) count their static part only
+These are reported per task, and --strict fails on them as well.
+"""
+
+import glob
+import os
+import re
+import sys
+
+NODE = re.compile(r'node: \{ title: "([^"]+)" label: "([^"]*)"')
+EDGE = re.compile(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+FRAME = re.compile(r'\\n(\d+) bytes \(([a-z,]+)\)')
+TASK_ENTRY = re.compile(r'X\((mainSTACK_\w+),\s*(\w+),\s*(\d+)\)')
+CONFIG = re.compile(r'#define\s+(config\w+)\s+(.*)')
+
+INDIRECT = "__indirect_call"
+WRAP = "__wrap_"
+PRINTF = {"printf", "vprintf", "sprintf", "snprintf", "vsnprintf", "puts", "putchar"}
+WORD = 4
+
+
+class CallGraph:
+    def __init__(self):
+        self.frames = {}     # title -> (bytes, qualifier)
+        self.calls = {}      # title -> set of titles
+        self.memo = {}
+
+    def load(self, path):
+        with open(path) as f:
+            text = f.read()
+        for title, label in NODE.findall(text):
+            frame = FRAME.search(label)
+            if frame:
+                size = int(frame.group(1))
+                # Weak and strong definitions of the same name, keep the larger
+                if size >= self.frames.get(title, (-1, ""))[0]:
+                    self.frames[title] = (size, frame.group(2))
+        for source, target in EDGE.findall(text):
+            self.calls.setdefault(source, set()).add(target)
+
+    def entry(self, name):
+        """Title of a task entry point, static ones carry their file."""
+        if name in self.frames:
+            return name
+        matches = [title for title in self.frames if title.endswith(":" + name)]
+        return max(matches, key=lambda title: self.frames[title][0]) if matches else None
+
+    def worst(self, title, costs, visiting):
+        """Deepest chain from title as (bytes, path, notes)."""
+        if title in self.memo:
+            return self.memo[title]
+        if title == INDIRECT:
+            return costs["indirect"], [title], set()
+        if title not in self.frames and WRAP + title in self.frames:
+            return self.worst(WRAP + title, costs, visiting)
+        if title in PRINTF and title not in self.frames:
+            return costs["printf"], [title], {"printf " + title}
+        if title not in self.frames:
+            return costs["external"], [title], {"external " + title}
+        if title in visiting:
+            return 0, [title], {"recursion " + title}
+
+        size, qualifier = self.frames[title]
+        notes = set()
+        if qualifier == "dynamic":
+            notes.add("dynamic " + title)
+        visiting.add(title)
+        deepest, path = 0, []
+        for callee in sorted(self.calls.get(title, ())):
+            depth, callee_path, callee_notes = self.worst(callee, costs, visiting)
+            notes |= callee_notes
+            if callee == INDIRECT:
+                notes.add("indirect from " + title)
+            if depth > deepest or not path:
+                deepest, path = depth, callee_path
+        visiting.discard(title)
+
+        result = size + deepest, [title] + path, notes
+        # Results below a cycle depend on where it was entered
+        if not any(note.startswith("recursion") for note in notes):
+            self.memo[title] = result
+        return result
+
+
+def config_value(text, name):
+    for key, value in CONFIG.findall(text):
+        if key == name:
+            return int(re.findall(r"\d+", value)[-1])
+    raise KeyError(name)
+
+
+def load_tasks(header, config):
+    with open(header) as f:
+        tasks = [(entry, int(words)) for _, entry, words in TASK_ENTRY.findall(f.read())]
+    with open(config) as f:
+        text = f.read()
+    tasks.append(("prvTimerTask", config_value(text, "configTIMER_TASK_STACK_DEPTH")))
+    idle = config_value(text, "configMINIMAL_STACK_SIZE")
+    tasks.append(("prvIdleTask", idle))
+    tasks.append(("prvPassiveIdleTask", idle))
+    return tasks
+
+
+def main():
+    args = sys.argv[1:]
+    costs = {"margin": 64, "indirect": 256, "external": 32, "printf": 512}
+    strict, verbose, paths = False, False, []
+    here = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+    try:
+        while args:
+            arg = args.pop(0)
+            if arg in ("--margin", "--indirect", "--external", "--printf"):
+                costs[arg[2:]] = int(args.pop(0))
+            elif arg == "--strict":
+                strict = True
+            elif arg == "-v":
+                verbose = True
+            elif not arg.startswith("-"):
+                paths.append(arg)
+            else:
+                raise ValueError(arg)
+        if not 1 <= len(paths) <= 3:
+            raise ValueError(paths)
+    except (IndexError, ValueError):
+        sys.stderr.write(__doc__)
+        return 2
+    build = paths[0]
+    header = paths[1] if len(paths) > 1 else os.path.join(here, "main.h")
+    config = paths[2] if len(paths) > 2 else os.path.join(here, "FreeRTOSConfig.h")
+
+    graph = CallGraph()
+    files = glob.glob(os.path.join(build, "**", "*.ci"), recursive=True)
+    if not files:
+        sys.stderr.write("No .ci files under %s, build with STACK_CHECK=1\n" % build)
+        return 2
+    for path in files:
+        graph.load(path)
+
+    failed = False
+    print("%-20s %8s %8s %8s" % ("task", "stack", "worst", "spare"))
+    for entry, words in load_tasks(header, config):
+        title = graph.entry(entry)
+        # Tasks of other build options, e.g. the stack profile
+        if not title:
+            print("%-20s not built in" % entry)
+            continue
+        depth, path, notes = graph.worst(title, costs, set())
+        depth += costs["margin"]
+        spare = words * WORD - depth
+        over = spare < 0 or (strict and bool(notes))
+        failed |= over
+        print("%-20s %8d %8d %8d%s" % (entry, words * WORD, depth, spare, "  OVERFLOW" if spare < 0 else ""))
+        if over or verbose:
+            print("    " + " > ".join(path))
+        for note in sorted(notes) if verbose or over else ():
+            print("    " + note)
+        if notes and not (verbose or over):
+            kinds = sorted({note.split()[0] for note in notes})
+            print("    assumed: " + ", ".join("%d %s" % (sum(n.startswith(k) for n in notes), k) for k in kinds))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
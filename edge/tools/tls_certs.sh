@@ -0,0 +1,52 @@
+#!/bin/bash
+# Self-signed CA and broker certificate for testing MQTT over TLS against a
+# local mosquitto. Writes everything to tools/certs:
+#   ca.crt, ca.key          the CA the edge trusts
+#   server.crt, server.key  for mosquitto
+#   mosquitto.conf          listener on 8883 using the above
+#   mqtt_ca_cert.h          the CA as a C string, built in with MQTT_TLS=1
+#
+# usage: tls_certs.sh [broker name] [broker ip]
+# The name has to match MQTT_TLS_HOSTNAME of the build.
+
+set -e
+
+NAME="${1:-fogberry-broker}"
+IP="${2:-192.168.60.120}"
+DIR="$(cd "$(dirname "$0")" && pwd)/certs"
+DAYS=3650
+
+mkdir -p "$DIR"
+cd "$DIR"
+
+# P-256 keeps the handshake affordable on the M0+, see mbedtls_config.h
+openssl ecparam -name prime256v1 -genkey -noout -out ca.key
+openssl req -new -x509 -key ca.key -out ca.crt -days "$DAYS" -subj "/CN=fogberry test CA"
+
+openssl ecparam -name prime256v1 -genkey -noout -out server.key
+openssl req -new -key server.key -out server.csr -subj "/CN=$NAME"
+openssl x509 -req -in server.csr -CA ca.crt -CAkey ca.key -CAcreateserial \
+  -out server.crt -days "$DAYS" \
+  -extfile <(printf "subjectAltName=DNS:%s,IP:%s" "$NAME" "$IP")
+rm -f server.csr
+
+# Plain MQTT stays available on the loopback for fog.sh on the same host
+cat > mosquitto.conf <<CONF
+listener 1883 127.0.0.1
+listener 8883
+allow_anonymous true
+cafile $DIR/ca.crt
+certfile $DIR/server.crt
+keyfile $DIR/server.key
+tls_version tlsv1.2
+CONF
+
+{
+  echo "// Generated by tools/tls_certs.sh"
+  echo "#define MQTT_TLS_CA_CERT \\"
+  sed 's/.*/"&\\n" \\/' ca.crt
+  echo '""'
+} > mqtt_ca_cert.h
+
+echo "Run the broker with: mosquitto -c $DIR/mosquitto.conf -v"
+echo "Build the edge with: MQTT_TLS=1 MQTT_TLS_HOSTNAME=$NAME"
@@ -0,0 +1,48 @@
+#include "topics.h"
+
+#include <stdio.h>
+
+static char pool[TOPICS_POOL_SIZE];
+static uint16_t offsets[TOPICS_MAX];
+static const char *const *topicNames;
+static uint8_t topicCount;
+
+bool topicsInit(const char *clientId, const char *const names[], uint8_t count, bool shortTopics) {
+    if (count > TOPICS_MAX) {
+        return false;
+    }
+
+    size_t used = 0;
+    for (uint8_t id = 0; id < count; id++) {
+        int len = shortTopics
+            ? snprintf(&pool[used], sizeof(pool) - used, "/%s/%u", clientId, id)
+            : snprintf(&pool[used], sizeof(pool) - used, "/%s%s", clientId, names[id]);
+        if (len < 0 || (size_t) len >= sizeof(pool) - used) {
+            return false;
+        }
+        offsets[id] = (uint16_t) used;
+        used += (size_t) len + 1;
+    }
+    topicNames = names;
+    topicCount = count;
+    return true;
+}
+
+const char *topicGet(TopicId id) {
+    return id < topicCount ? &pool[offsets[id]] : NULL;
+}
+
+size_t topicsAliasTable(char *out, size_t len) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (uint8_t id = 0; id < topicCount; id++) {
+        int n = snprintf(&out[used], len - used, "%s%u=%s", id ? "," : "", id, topicNames[id]);
+        if (n < 0 || (size_t) n >= len - used) {
+            // Drop the entry that did not fit
+            out[used] = '\0';
+            break;
+        }
+        used += (size_t) n;
+    }
+    return used;
+}
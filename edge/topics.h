@@ -0,0 +1,24 @@
+#ifndef TOPICS_H
+#define TOPICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t TopicId;
+
+#define TOPICS_MAX 32
+// Shared storage for all full topic strings
+#define TOPICS_POOL_SIZE 1024
+
+// Builds "/<clientId><name>" for every name once, so publishing only looks
+// up a pointer. `names` is indexed by TopicId. With shortTopics set the
+// topic becomes "/<clientId>/<id>" to keep PUBLISH headers small.
+bool topicsInit(const char *clientId, const char *const names[], uint8_t count, bool shortTopics);
+
+const char *topicGet(TopicId id);
+
+// Formats the "<id>=<name>,..." table that maps short topics back to names
+size_t topicsAliasTable(char *out, size_t len);
+
+#endif //TOPICS_H
@@ -0,0 +1,26 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "topics.h"
+
+// What the publishers in main.c send through, MQTT over TCP or MQTT-SN
+// over UDP. Picked at build time, every publisher goes through it.
+// Payloads are formatted straight into buffers the transport owns, the only
+// copy left is one the transport makes itself, e.g. the lwIP MQTT client
+// into its output ring. One publishing task at a time, and every reserve
+// is followed by a send.
+typedef struct Transport {
+    const char *name;
+    // Space for the next payload of up to `size` bytes with the NUL,
+    // NULL when there is none
+    char *(*reserve)(void *ctx, size_t size, size_t *capacity);
+    // Sends the NUL terminated payload written into the reserved space.
+    // False when it could not be handed on.
+    bool (*send)(void *ctx, TopicId topic, const char *payload, size_t len);
+    void *ctx;
+} Transport;
+
+#endif //TRANSPORT_H
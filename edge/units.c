@@ -0,0 +1,138 @@
+#include "units.h"
+
+#include <string.h>
+
+#include "hotpath.h"
+#include "adc_lut.h"
+
+#define UNITS_TABLE_SIZE(table) (sizeof(table) / sizeof((table)[0]))
+
+// ADC full scale, 3.3 V over 12 bits
+#define ADC_COUNTS 4095
+#define ADC_VREF_MV 3300
+// Microvolts per count in Q8, keeps the temperature math in 32 bits
+#define ADC_UV_PER_COUNT_Q8 ((ADC_VREF_MV * 1000u * 256u + ADC_COUNTS / 2) / ADC_COUNTS)
+
+// RP2040 datasheet 4.9.5: 0.706 V at 27 degrees, -1.721 mV per degree
+#define DIE_UV_AT_27 706000
+#define DIE_UV_PER_CENTI_NUM 1721
+#define DIE_UV_PER_CENTI_DEN 100
+
+// The MQ-7's load resistor runs off 5 V, Rs = RL * (5 V - Vout) / Vout
+#define MQ7_SUPPLY_MV 5000
+#define Q12 (1 << 12)
+
+// ADA161 and MQ-7 boards as sold, a 10k/20k divider brings the MQ-7's 5 V
+// output into the ADC range. R0 varies most from part to part and should be
+// measured in 100 ppm CO, the die offset against a thermometer.
+static UnitsCal cal = {
+    .lightDark = 0,
+    .lightGain = UNITS_CAL_UNITY,
+    .gasR0 = 10000,
+    .gasLoad = 10000,
+    .gasDivider = UNITS_CAL_UNITY * 2 / 3,
+    .dieAboveAmbient = 0,
+};
+
+UnitsCal *unitsCalibration(void) {
+    return &cal;
+}
+
+void unitsSetCalibration(const UnitsCal *newCal) {
+    cal = *newCal;
+}
+
+bool unitsConfigure(const char *name, uint32_t value) {
+    if (strcmp(name, "light_dark") == 0) {
+        if (value >= ADC_COUNTS) {
+            return false;
+        }
+        cal.lightDark = value;
+    } else if (strcmp(name, "light_gain_q14") == 0) {
+        if (value == 0 || value > 16 * UNITS_CAL_UNITY) {
+            return false;
+        }
+        cal.lightGain = value;
+    } else if (strcmp(name, "gas_r0_ohms") == 0) {
+        if (value == 0) {
+            return false;
+        }
+        cal.gasR0 = value;
+    } else if (strcmp(name, "gas_load_ohms") == 0) {
+        if (value == 0 || value > 1000000) {
+            return false;
+        }
+        cal.gasLoad = value;
+    } else if (strcmp(name, "gas_divider_q14") == 0) {
+        if (value == 0 || value > UNITS_CAL_UNITY) {
+            return false;
+        }
+        cal.gasDivider = value;
+    } else if (strcmp(name, "die_above_ambient_centi") == 0) {
+        if (value > 5000) {
+            return false;
+        }
+        cal.dieAboveAmbient = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Linear between the two points around x, the end values outside the table
+static int32_t HOT_PATH(interpolate)(const UnitsPoint *table, uint32_t count, int32_t x) {
+    if (x <= table[0].x) {
+        return table[0].y;
+    }
+    if (x >= table[count - 1].x) {
+        return table[count - 1].y;
+    }
+    uint32_t low = 0;
+    uint32_t high = count - 1;
+    while (high - low > 1) {
+        const uint32_t mid = (low + high) / 2;
+        if (table[mid].x <= x) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    const UnitsPoint *a = &table[low];
+    const UnitsPoint *b = &table[high];
+    return a->y + (b->y - a->y) * (x - a->x) / (b->x - a->x);
+}
+
+int32_t HOT_PATH(unitsAmbient)(uint32_t counts) {
+    const int32_t microvolts = (int32_t) ((counts * ADC_UV_PER_COUNT_Q8) >> 8);
+    const int32_t die = 2700 - (microvolts - DIE_UV_AT_27) * DIE_UV_PER_CENTI_DEN / DIE_UV_PER_CENTI_NUM;
+    return die - (int32_t) cal.dieAboveAmbient;
+}
+
+uint32_t HOT_PATH(unitsLightLux)(uint32_t counts) {
+    counts = counts > cal.lightDark ? counts - cal.lightDark : 0;
+    counts = (counts * cal.lightGain) >> 14;
+    if (counts > ADC_COUNTS) {
+        counts = ADC_COUNTS;
+    }
+    return (uint32_t) interpolate(lightLux, UNITS_TABLE_SIZE(lightLux), (int32_t) counts);
+}
+
+uint32_t HOT_PATH(unitsGasPpm)(uint32_t counts, int32_t ambient) {
+    // At the ADC pin, then at the board's output ahead of the divider
+    const uint32_t pinMv = (counts * ADC_VREF_MV + ADC_COUNTS / 2) / ADC_COUNTS;
+    const uint32_t outMv = pinMv * UNITS_CAL_UNITY / cal.gasDivider;
+    const uint32_t dropMv = outMv < MQ7_SUPPLY_MV ? MQ7_SUPPLY_MV - outMv : 0;
+
+    // Rs/R0 in Q12 as measured, then as it would be at 20 degrees.
+    // No output at all is an open sensor, the clean air end of the table.
+    uint64_t ratio = INT32_MAX;
+    if (outMv) {
+        ratio = ((uint64_t) cal.gasLoad * dropMv * Q12) / ((uint64_t) outMv * cal.gasR0);
+    }
+    const int32_t factor = interpolate(gasTemperature, UNITS_TABLE_SIZE(gasTemperature), ambient);
+    ratio = ratio * Q12 / (uint32_t) factor;
+    if (ratio > INT32_MAX) {
+        ratio = INT32_MAX;
+    }
+    return (uint32_t) interpolate(gasPpm, UNITS_TABLE_SIZE(gasPpm), (int32_t) ratio);
+}
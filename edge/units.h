@@ -0,0 +1,50 @@
+#ifndef UNITS_H
+#define UNITS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Turns ADC counts of the analog sensors into engineering units on the
+// edge, so the fog and the server store lux and ppm rather than counts.
+// The curves are tables generated at build time by tools/adc_lut.py and
+// interpolated in integers, nothing here uses floats.
+
+// ADC input of the RP2040's own temperature sensor
+#define UNITS_TEMPERATURE_INPUT 4
+
+// Bump when the layout of UnitsCal changes, stored records are then ignored
+#define UNITS_CAL_VERSION 1
+// 1.0 in the Q14 factors below
+#define UNITS_CAL_UNITY (1 << 14)
+
+// Per device constants, kept in flash
+typedef struct UnitsCal {
+    uint32_t lightDark;         // counts read with the sensor covered
+    uint32_t lightGain;         // Q14, applied to counts before the table
+    uint32_t gasR0;             // ohms, MQ-7 Rs in 100 ppm CO
+    uint32_t gasLoad;           // ohms, RL on the MQ-7 board
+    uint32_t gasDivider;        // Q14, ADC pin voltage over board output
+    uint32_t dieAboveAmbient;   // centi-degrees the RP2040 runs above the air
+} UnitsCal;
+
+typedef struct UnitsPoint {
+    int32_t x;
+    int32_t y;
+} UnitsPoint;
+
+// Starts from the datasheet values, see units.c
+UnitsCal *unitsCalibration(void);
+void unitsSetCalibration(const UnitsCal *cal);
+
+// Sets one field by its config name, false for an unknown name or a value
+// the conversions cannot use. Each field is a single word.
+bool unitsConfigure(const char *name, uint32_t value);
+
+// Air temperature in centi-degrees from a reading of UNITS_TEMPERATURE_INPUT
+int32_t unitsAmbient(uint32_t counts);
+
+uint32_t unitsLightLux(uint32_t counts);
+// MQ-7 reading compensated for the air temperature, in centi-degrees
+uint32_t unitsGasPpm(uint32_t counts, int32_t ambient);
+
+#endif //UNITS_H
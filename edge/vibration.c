@@ -0,0 +1,141 @@
+#include "vibration.h"
+
+#include <math.h>
+
+#define HALF_SIZE (VIBRATION_FFT_SIZE / 2)
+
+// Tables are built once at init, the per window path is integer only
+static int16_t window[VIBRATION_FFT_SIZE];
+static int16_t twiddleCos[HALF_SIZE];
+static int16_t twiddleSin[HALF_SIZE];
+
+// Working buffers, only one window is processed at a time
+static int16_t re[VIBRATION_FFT_SIZE];
+static int16_t im[VIBRATION_FFT_SIZE];
+
+static inline int16_t q15Mul(int16_t a, int16_t b) {
+    return (int16_t) (((int32_t) a * b) >> 15);
+}
+
+static inline int16_t saturate16(int32_t x) {
+    if (x > INT16_MAX) return INT16_MAX;
+    if (x < INT16_MIN) return INT16_MIN;
+    return (int16_t) x;
+}
+
+static uint32_t isqrt64(uint64_t x) {
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t) 1 << 62;
+    while (bit > x) bit >>= 2;
+    while (bit != 0) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t) res;
+}
+
+static inline uint16_t bitReverse(uint16_t x) {
+    uint16_t r = 0;
+    for (int i = 0; i < VIBRATION_FFT_LOG2; i++) {
+        r = (r << 1) | (x & 1);
+        x >>= 1;
+    }
+    return r;
+}
+
+void vibrationInit(void) {
+    const double twoPi = 6.283185307179586;
+    for (int i = 0; i < VIBRATION_FFT_SIZE; i++) {
+        // Hann window
+        window[i] = (int16_t) (16383.5 * (1.0 - cos(twoPi * i / (VIBRATION_FFT_SIZE - 1))));
+    }
+    for (int i = 0; i < HALF_SIZE; i++) {
+        twiddleCos[i] = (int16_t) (32767.0 * cos(twoPi * i / VIBRATION_FFT_SIZE));
+        twiddleSin[i] = (int16_t) (32767.0 * sin(twoPi * i / VIBRATION_FFT_SIZE));
+    }
+}
+
+// In place radix-2 decimation in time FFT. Every stage halves the result so
+// the output is scaled by 1/N and can never overflow Q15.
+static void fftQ15(int16_t *xr, int16_t *xi) {
+    for (uint16_t i = 0; i < VIBRATION_FFT_SIZE; i++) {
+        uint16_t j = bitReverse(i);
+        if (j > i) {
+            int16_t t = xr[i]; xr[i] = xr[j]; xr[j] = t;
+            t = xi[i]; xi[i] = xi[j]; xi[j] = t;
+        }
+    }
+
+    for (int stage = 1; stage <= VIBRATION_FFT_LOG2; stage++) {
+        const int size = 1 << stage;
+        const int half = size >> 1;
+        const int step = VIBRATION_FFT_SIZE / size;
+        for (int start = 0; start < VIBRATION_FFT_SIZE; start += size) {
+            for (int k = 0; k < half; k++) {
+                // W = e^(-j*2*pi*k/size)
+                const int16_t wr = twiddleCos[k * step];
+                const int16_t wi = (int16_t) -twiddleSin[k * step];
+                const int a = start + k;
+                const int b = a + half;
+
+                const int32_t tr = q15Mul(xr[b], wr) - q15Mul(xi[b], wi);
+                const int32_t ti = q15Mul(xr[b], wi) + q15Mul(xi[b], wr);
+
+                xr[b] = saturate16((xr[a] - tr) >> 1);
+                xi[b] = saturate16((xi[a] - ti) >> 1);
+                xr[a] = saturate16((xr[a] + tr) >> 1);
+                xi[a] = saturate16((xi[a] + ti) >> 1);
+            }
+        }
+    }
+}
+
+void vibrationCompute(const int16_t *samples, uint32_t sampleRateHz, VibrationFeatures *out) {
+    // Remove the DC component (gravity and sensor offset)
+    int32_t sum = 0;
+    for (int i = 0; i < VIBRATION_FFT_SIZE; i++) {
+        sum += samples[i];
+    }
+    const int32_t mean = sum / VIBRATION_FFT_SIZE;
+
+    uint64_t sumSquares = 0;
+    uint32_t peak = 0;
+    for (int i = 0; i < VIBRATION_FFT_SIZE; i++) {
+        const int16_t x = saturate16(samples[i] - mean);
+        const uint32_t mag = x < 0 ? (uint32_t) -x : (uint32_t) x;
+        sumSquares += (uint64_t) mag * mag;
+        if (mag > peak) peak = mag;
+
+        re[i] = q15Mul(x, window[i]);
+        im[i] = 0;
+    }
+
+    out->rms = isqrt64(sumSquares / VIBRATION_FFT_SIZE);
+    out->peak = peak;
+    out->crestFactor = out->rms ? (peak * 100) / out->rms : 0;
+
+    fftQ15(re, im);
+
+    uint64_t bands[VIBRATION_BANDS] = {0};
+    uint32_t peakPower = 0;
+    int peakBin = 0;
+    // Skip bin 0, what is left of DC after windowing is not vibration
+    for (int k = 1; k < HALF_SIZE; k++) {
+        const uint32_t power = (uint32_t) ((int32_t) re[k] * re[k]) + (uint32_t) ((int32_t) im[k] * im[k]);
+        if (power > peakPower) {
+            peakPower = power;
+            peakBin = k;
+        }
+        bands[(k * VIBRATION_BANDS) / HALF_SIZE] += power;
+    }
+
+    out->peakFreqDeciHz = (uint32_t) (((uint64_t) peakBin * sampleRateHz * 10) / VIBRATION_FFT_SIZE);
+    for (int b = 0; b < VIBRATION_BANDS; b++) {
+        out->bandEnergy[b] = bands[b] > UINT32_MAX ? UINT32_MAX : (uint32_t) bands[b];
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef VIBRATION_H
+#define VIBRATION_H
+
+#include <stdint.h>
+
+// 256 point FFT, at 1 kHz this is ~3.9 Hz per bin
+#define VIBRATION_FFT_LOG2 8
+#define VIBRATION_FFT_SIZE (1 << VIBRATION_FFT_LOG2)
+
+// Number of equal width bands between DC and Nyquist
+#define VIBRATION_BANDS 4
+
+typedef struct VibrationFeatures {
+    uint32_t rms;           // raw accel counts, DC removed
+    uint32_t peak;          // largest absolute deviation from DC
+    uint32_t crestFactor;   // peak / rms, scaled by 100
+    uint32_t peakFreqDeciHz;
+    uint32_t bandEnergy[VIBRATION_BANDS];
+} VibrationFeatures;
+
+// Builds the window and twiddle tables, call once before computing
+void vibrationInit(void);
+
+// Computes features over exactly VIBRATION_FFT_SIZE samples
+void vibrationCompute(const int16_t *samples, uint32_t sampleRateHz, VibrationFeatures *out);
+
+#endif //VIBRATION_H
@@ -0,0 +1,218 @@
+#include "wifi.h"
+
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/cyw43_arch.h>
+#include "lwip/dhcp.h"
+#include "lwip/prot/dhcp.h"
+#include "lwip/timeouts.h"
+
+#include "crc32.h"
+#include "storage.h"
+
+// How often join and DHCP progress is checked for the boot timings
+#define WIFI_POLL_MS 10
+
+static const char *joinSsid;
+static const char *joinPassword;
+static uint8_t cacheSlot;
+static WifiCache cache;
+static bool cacheValid;
+// The cached lease was put back and has not been confirmed or refused yet
+static bool leaseRestored;
+static bool usedCache;
+static volatile uint32_t joinedAtMs;
+static volatile uint32_t boundAtMs;
+
+static inline struct netif *staNetif(void) {
+    return &cyw43_state.netif[CYW43_ITF_STA];
+}
+
+static inline uint32_t nowMs(void) {
+    return to_ms_since_boot(get_absolute_time());
+}
+
+// Same trick as a stored lease on other stacks: with the client marked as
+// bound, the link coming up makes lwIP request the old address straight
+// away instead of discovering. A NAK falls back to a normal DISCOVER.
+static void restoreLease(const WifiCache *lease) {
+    struct netif *netif = staNetif();
+    struct dhcp *dhcp = netif_dhcp_data(netif);
+    if (!dhcp) {
+        return;
+    }
+
+    ip4_addr_t ip, netmask, gateway;
+    ip4_addr_set_u32(&ip, lease->ip);
+    ip4_addr_set_u32(&netmask, lease->netmask);
+    ip4_addr_set_u32(&gateway, lease->gateway);
+    netif_set_addr(netif, &ip, &netmask, &gateway);
+
+    ip4_addr_copy(dhcp->offered_ip_addr, ip);
+    ip4_addr_copy(dhcp->offered_sn_mask, netmask);
+    ip4_addr_copy(dhcp->offered_gw_addr, gateway);
+    // No lease time until a server ACKs it, see leaseConfirmed
+    dhcp->offered_t0_lease = 0;
+    dhcp->state = DHCP_STATE_BOUND;
+}
+
+// A restored lease makes dhcp_supplied_address() true before the link is
+// even up. Every ACK carries the lease time, so a non-zero one means a
+// server handed out or confirmed the address on this link.
+static bool leaseConfirmed(struct netif *netif) {
+    const struct dhcp *dhcp = netif_dhcp_data(netif);
+    return dhcp_supplied_address(netif) && dhcp && dhcp->offered_t0_lease;
+}
+
+// Runs in lwIP context until both timestamps are taken
+static void pollProgress(void *arg) {
+    (void) arg;
+    if (!joinedAtMs && cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_JOIN) {
+        joinedAtMs = nowMs();
+    }
+    if (joinedAtMs && !boundAtMs && leaseConfirmed(staNetif())) {
+        boundAtMs = nowMs();
+    }
+    if (!joinedAtMs || !boundAtMs) {
+        sys_timeout(WIFI_POLL_MS, pollProgress, NULL);
+    }
+}
+
+static int join(const uint8_t *bssid, uint32_t channel) {
+    return cyw43_wifi_join(&cyw43_state,
+                           strlen(joinSsid), (const uint8_t *) joinSsid,
+                           strlen(joinPassword), (const uint8_t *) joinPassword,
+                           CYW43_AUTH_WPA2_AES_PSK, bssid, channel);
+}
+
+void wifiStart(const char *ssid, const char *password, uint8_t storageSlot, bool useCache) {
+    joinSsid = ssid;
+    joinPassword = password;
+    cacheSlot = storageSlot;
+
+    cacheValid = useCache
+                 && storageLoad(storageSlot, WIFI_CACHE_VERSION, &cache, sizeof(cache))
+                 && cache.ssidCrc == crc32(ssid, strlen(ssid));
+    leaseRestored = cacheValid;
+
+    cyw43_arch_lwip_begin();
+    if (cacheValid) {
+        restoreLease(&cache);
+    }
+    sys_timeout(WIFI_POLL_MS, pollProgress, NULL);
+    cyw43_arch_lwip_end();
+
+    usedCache = cacheValid && join(cache.bssid, cache.channel) == 0;
+    if (!usedCache) {
+        join(NULL, CYW43_CHANNEL_NONE);
+    }
+}
+
+static int waitLink(uint32_t deadlineMs) {
+    int status;
+    while ((status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA)) != CYW43_LINK_UP) {
+        if (status < 0 || (int32_t) (nowMs() - deadlineMs) >= 0) {
+            return status;
+        }
+        sleep_ms(WIFI_POLL_MS);
+    }
+    return status;
+}
+
+// The link reports up as soon as it has an address, which a restored lease
+// gives it right away. Wait for a server to confirm that address, or to
+// hand out another one after a NAK, before anything connects with it.
+static bool waitLease(uint32_t deadlineMs) {
+    if (!leaseRestored) {
+        return true;
+    }
+    for (;;) {
+        cyw43_arch_lwip_begin();
+        struct netif *netif = staNetif();
+        const bool confirmed = leaseConfirmed(netif);
+        const uint32_t ip = ip4_addr_get_u32(netif_ip4_addr(netif));
+        cyw43_arch_lwip_end();
+        if (confirmed) {
+            leaseRestored = false;
+            if (ip != cache.ip) {
+                // Refused, the cache no longer matches and gets replaced
+                cacheValid = false;
+            }
+            return true;
+        }
+        if ((int32_t) (nowMs() - deadlineMs) >= 0) {
+            return false;
+        }
+        sleep_ms(WIFI_POLL_MS);
+    }
+}
+
+static bool waitUp(uint32_t timeoutMs) {
+    const uint32_t deadlineMs = nowMs() + timeoutMs;
+    return waitLink(deadlineMs) == CYW43_LINK_UP && waitLease(deadlineMs);
+}
+
+bool wifiWaitUp(uint32_t timeoutMs) {
+    if (waitUp(timeoutMs)) {
+        return true;
+    }
+    if (!usedCache) {
+        return false;
+    }
+
+    // The access point may have moved channel or gone, scan for the network.
+    // The scan alone takes seconds, so it gets a timeout of its own.
+    usedCache = false;
+    if (join(NULL, CYW43_CHANNEL_NONE) != 0) {
+        return false;
+    }
+    return waitUp(timeoutMs);
+}
+
+bool wifiUsedCache(void) {
+    return usedCache;
+}
+
+uint32_t wifiJoinedAtMs(void) {
+    return joinedAtMs;
+}
+
+uint32_t wifiBoundAtMs(void) {
+    return boundAtMs;
+}
+
+bool wifiSaveCache(void) {
+    WifiCache current = {
+        .ssidCrc = crc32(joinSsid, strlen(joinSsid)),
+    };
+    if (cyw43_wifi_get_bssid(&cyw43_state, current.bssid) != 0) {
+        return false;
+    }
+    // channel_info_t, the first word is the channel in use
+    uint32_t channelInfo[3];
+    if (cyw43_ioctl(&cyw43_state, CYW43_IOCTL_GET_CHANNEL, sizeof(channelInfo), (uint8_t *) channelInfo, CYW43_ITF_STA) != 0) {
+        return false;
+    }
+    current.channel = (uint8_t) channelInfo[0];
+
+    cyw43_arch_lwip_begin();
+    struct netif *netif = staNetif();
+    const bool bound = leaseConfirmed(netif);
+    current.ip = ip4_addr_get_u32(netif_ip4_addr(netif));
+    current.netmask = ip4_addr_get_u32(netif_ip4_netmask(netif));
+    current.gateway = ip4_addr_get_u32(netif_ip4_gw(netif));
+    cyw43_arch_lwip_end();
+    if (!bound) {
+        return false;
+    }
+
+    if (cacheValid && memcmp(&current, &cache, sizeof(current)) == 0) {
+        return true;
+    }
+    if (!storageSave(cacheSlot, WIFI_CACHE_VERSION, &current, sizeof(current))) {
+        return false;
+    }
+    cache = current;
+    cacheValid = true;
+    return true;
+}
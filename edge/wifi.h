@@ -0,0 +1,46 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bump when the layout of WifiCache changes, stored records are then ignored
+#define WIFI_CACHE_VERSION 1
+
+// What the last successful join left behind, kept in a storage slot
+typedef struct WifiCache {
+    uint32_t ssidCrc;   // only used for the network it was taken on
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t _reserved;
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gateway;
+} WifiCache;
+
+// Starts joining without waiting. With a cache for this network the join is
+// directed at the last access point and channel, skipping the scan, and the
+// last lease is put back so DHCP only has to confirm it (INIT-REBOOT).
+// useCache false ignores the stored record, the next wifiSaveCache then
+// replaces it. Station mode must already be enabled.
+void wifiStart(const char *ssid, const char *password, uint8_t storageSlot, bool useCache);
+
+// Waits until the link is up with an address a DHCP server confirmed, a
+// restored lease counts once it was ACKed. A directed join that fails
+// falls back to a full scan once, which gets another timeoutMs. Returns
+// false on timeout or failure.
+bool wifiWaitUp(uint32_t timeoutMs);
+
+// True when the cached access point and lease were used
+bool wifiUsedCache(void);
+
+// Milliseconds since boot when the join completed and DHCP bound, 0 until
+// then. With a cached lease, bound is when the server confirmed it.
+uint32_t wifiJoinedAtMs(void);
+uint32_t wifiBoundAtMs(void);
+
+// Stores the current access point and lease if they changed. Writes flash,
+// call from a task once DHCP has bound.
+bool wifiSaveCache(void);
+
+#endif //WIFI_H
@@ -9,33 +9,123 @@ TOPIC="#"  # Subscribe to all topics
 TMP_DIR="/tmp/mqtt_aggregation"
 mkdir -p "$TMP_DIR"
 
-# Function to add value and compute/send average if 5 values exist
+# Get a "key=value" field from a "<value>;key=value;..." payload
+payload_field() {
+  local payload="$1"
+  local key="$2"
+  echo "$payload" | tr ';' '\n' | awk -F= -v k="$key" '$1 == k { print $2 }'
+}
+
+# Edge timestamps are epoch milliseconds, fall back to now without one
+epoch_seconds() {
+  local millis="$1"
+  if [[ -n "$millis" ]]; then
+    echo $((millis / 1000))
+  else
+    date +%s
+  fi
+}
+
+# Compare a sequence number with the last one seen on the topic. Prints
+# how many were skipped, which the fog also adds to its running total.
+check_sequence() {
+  local key_file="$1"
+  local topic="$2"
+  local seq="$3"
+  local last gap=0
+  [[ -f "$key_file.seq" ]] && last=$(< "$key_file.seq")
+  echo "$seq" > "$key_file.seq"
+
+  # A lower number means the edge restarted, not that anything was lost
+  if [[ -n "$last" && "$seq" -gt $((last + 1)) ]]; then
+    gap=$((seq - last - 1))
+    local total=0
+    [[ -f "$key_file.lost" ]] && total=$(< "$key_file.lost")
+    echo $((total + gap)) > "$key_file.lost"
+    echo "Gap on $topic: $gap lost before $seq, $((total + gap)) in total" >&2
+  fi
+  echo "$gap"
+}
+
+# JSON member carrying the sequence range an entry covers, empty without one.
+# The stream names the edge counter the numbers come from, samples and
+# aggregate windows of one measurement are numbered separately.
+sequence_json() {
+  local first="$1"
+  local last="$2"
+  local lost="$3"
+  local stream="$4"
+  [[ -n "$first" ]] || return
+  echo "\"sequence\": { \"stream\": \"$stream\", \"first\": $first, \"last\": $last, \"lost\": $lost },"
+}
+
+# MQ-7 readings carry the heater phase they were taken in, only the
+# measuring phase reads CO. The edge drops the rest at the source,
+# anything else that still arrives is not stored either.
+valid_phase() {
+  local phase
+  phase=$(payload_field "$1" ph)
+  [[ -z "$phase" || "$phase" == "measure" ]]
+}
+
+# JSON member with the unit the edge converted to, empty for raw counts
+unit_json() {
+  local unit="$1"
+  [[ -n "$unit" ]] || return
+  echo "\"unit\": \"$unit\","
+}
+
+# Function to add value and compute/send average once 5 values exist
 process_message() {
   local topic="$1"
-  local value="$2"
+  local payload="$2"
+  local value="${payload%%;*}"
+  valid_phase "$payload" || return
 
   # Remove leading slash and replace slashes with underscores for filename
   local topic_key="${topic#/}"  # Remove leading slash
   local key_file="$TMP_DIR/$(echo "$topic_key" | tr '/' '_')"
 
-  # Append value to file
-  echo "$value" >> "$key_file"
+  # Readings the edge suppressed by its deadband held the previous value,
+  # put them back so the series is the same as if all were sent
+  local suppressed held
+  suppressed=$(payload_field "$payload" s)
+  held=$(payload_field "$payload" h)
+  if [[ -n "$suppressed" && -n "$held" ]]; then
+    for ((i = 0; i < suppressed; i++)); do
+      echo "$held" >> "$key_file"
+    done
+  fi
+
+  local seq gap=0
+  seq=$(payload_field "$payload" q)
+  [[ -n "$seq" ]] && gap=$(check_sequence "$key_file" "$topic" "$seq")
 
-  # Keep only the last 5 values
-  tail -n 5 "$key_file" > "$key_file.tmp" && mv "$key_file.tmp" "$key_file"
+  # Append value to file, with the edge capture time (ms), sequence number
+  # and the gap in front of it when the edge sends them
+  echo "$value $(payload_field "$payload" t) $seq $gap" >> "$key_file"
 
   # Count how many values we have
   count=$(wc -l < "$key_file")
 
-  # If we have 5, compute average and send
-  if [[ "$count" -eq 5 ]]; then
+  # Held values can push a window past 5, it is posted whole so none drop
+  if [[ "$count" -ge 5 ]]; then
     avg=$(awk '{sum+=$1} END {if (NR>0) print sum/NR}' "$key_file")
 
     # Extract topic parts
     IFS='/' read -r _ device_id sensor sensor_measurement <<< "$topic"
 
-    # Timestamp
-    timestamp=$(date +%s)
+    # Timestamp of the newest reading as taken on the edge,
+    # our own clock only for devices that have not synced yet
+    timestamp=$(epoch_seconds "$(tail -n 1 "$key_file" | awk '{ print $2 }')")
+
+    # Gaps inside the window, the one before its first reading is for the
+    # server to see against the previous window
+    local first last lost
+    read -r first last lost < <(awk '$3 != "" { if (first == "") first = $3; else lost += $4; last = $3 }
+      END { print first, last, lost + 0 }' "$key_file")
+    sequence=$(sequence_json "$first" "$last" "$lost" "$sensor_measurement")
+    unit=$(unit_json "$(payload_field "$payload" u)")
 
     # Construct JSON
     json=$(cat <<EOF
@@ -43,7 +133,9 @@ process_message() {
   "entries": [{
     "controller": "$device_id",
     "timestamp": $timestamp,
+    $sequence
     "$sensor": {
+      $unit
       "_type": "$sensor_measurement",
       "$sensor_measurement": $avg
     }
@@ -63,10 +155,124 @@ EOF
   fi
 }
 
+# The edge's own counters, next sequence number and queue drops
+process_stats() {
+  local topic="$1"
+  local payload="$2"
+  local key_file="$TMP_DIR/$(echo "${topic%/stats}" | sed 's|^/||' | tr '/' '_')"
+  local lost=0
+  [[ -f "$key_file.lost" ]] && lost=$(< "$key_file.lost")
+  echo "Stats for ${topic%/stats}: edge next=$(payload_field "$payload" q)" \
+    "dropped=$(payload_field "$payload" drop) windows dropped=$(payload_field "$payload" aggdrop)," \
+    "fog saw $lost missing"
+}
+
+# Store the short topic table a device publishes as "0=/sensor/measurement,..."
+store_aliases() {
+  local device_id="$1"
+  local table="$2"
+  echo "$table" | tr ',' '\n' | tr '=' ' ' > "$TMP_DIR/aliases_$device_id"
+}
+
+# Map /device/<id> back to /device/sensor/measurement
+resolve_alias() {
+  local device_id="$1"
+  local alias_id="$2"
+  local alias_file="$TMP_DIR/aliases_$device_id"
+  [[ -f "$alias_file" ]] || return 1
+  awk -v id="$alias_id" '$1 == id { print $2 }' "$alias_file"
+}
+
+# Aggregates are already reduced on the edge, post them as they come
+process_aggregate() {
+  local topic="$1"
+  local payload="$2"
+
+  local count min max sum
+  valid_phase "$payload" || return
+  count=$(payload_field "$payload" n)
+  min=$(payload_field "$payload" min)
+  max=$(payload_field "$payload" max)
+  sum=$(payload_field "$payload" sum)
+  [[ "$count" -gt 0 ]] || return
+
+  avg=$(awk -v s="$sum" -v n="$count" 'BEGIN { print s / n }')
+
+  IFS='/' read -r _ device_id sensor sensor_measurement _ <<< "$topic"
+  timestamp=$(epoch_seconds "$(payload_field "$payload" t)")
+
+  # One window per message, the server spots missing ones from the range
+  local seq key_file
+  seq=$(payload_field "$payload" q)
+  key_file="$TMP_DIR/$(echo "${topic#/}" | tr '/' '_')"
+  [[ -n "$seq" ]] && check_sequence "$key_file" "$topic" "$seq" > /dev/null
+  sequence=$(sequence_json "$seq" "$seq" 0 "$sensor_measurement/agg")
+  unit=$(unit_json "$(payload_field "$payload" u)")
+
+  json=$(cat <<EOF
+{
+  "entries": [{
+    "controller": "$device_id",
+    "timestamp": $timestamp,
+    $sequence
+    "$sensor": {
+      $unit
+      "_type": "$sensor_measurement",
+      "$sensor_measurement": $avg,
+      "${sensor_measurement}_min": $min,
+      "${sensor_measurement}_max": $max
+    }
+  }]
+}
+EOF
+)
+
+  curl -s -X POST -H "Content-Type: application/json" \
+    -d "$json" https://bso.moj-plac.si/api/v1/submit
+
+  echo "Sent aggregate for $topic: $avg over $count samples"
+}
+
 # Listen and process MQTT messages
 mosquitto_sub -v -h "$MQTT_BROKER" -p "$MQTT_PORT" -t "$TOPIC" | while read -r topic value; do
+  # Short topics: device/<id>, resolved through the device's alias table
+  if [[ "$topic" =~ ^/([^/]+)/topics$ ]]; then
+    store_aliases "${BASH_REMATCH[1]}" "$value"
+    continue
+  elif [[ "$topic" =~ ^/([^/]+)/([0-9]+)$ ]]; then
+    device_id="${BASH_REMATCH[1]}"
+    name=$(resolve_alias "$device_id" "${BASH_REMATCH[2]}")
+    [[ -n "$name" ]] && topic="/$device_id$name"
+  fi
+
+  # Boot timings: device/boot, milliseconds since reset per phase
+  if [[ "$topic" =~ ^/([^/]+)/boot$ ]]; then
+    echo "Boot profile for ${BASH_REMATCH[1]}: $value"
+  # TLS connect cost: device/tls, after every (re)connect
+  elif [[ "$topic" =~ ^/([^/]+)/tls$ ]]; then
+    echo "TLS connect for ${BASH_REMATCH[1]}: $value"
+  # MQTT-SN counters: device/transport, with the per stream stats
+  elif [[ "$topic" =~ ^/([^/]+)/transport$ ]]; then
+    echo "Transport for ${BASH_REMATCH[1]}: $value"
+  # Heap and block pool use: device/mem
+  elif [[ "$topic" =~ ^/([^/]+)/mem$ ]]; then
+    echo "Memory for ${BASH_REMATCH[1]}: $value"
+  # Contested SRAM accesses per second and the memory layout: device/bus
+  elif [[ "$topic" =~ ^/([^/]+)/bus$ ]]; then
+    echo "Bus contention for ${BASH_REMATCH[1]}: $value"
+  # Spectrum features of one accelerometer window: device/MPU9250/vibration
+  elif [[ "$topic" =~ ^/([^/]+)/MPU9250/vibration$ ]]; then
+    echo "Vibration for ${BASH_REMATCH[1]}: $value"
+  # Card reads at the entrance readers: device/door
+  elif [[ "$topic" =~ ^/([^/]+)/door$ ]]; then
+    echo "Door for ${BASH_REMATCH[1]}: $value"
+  # Window aggregates: device/sensor/measurement/agg
+  elif [[ "$topic" =~ ^/[^/]+/[^/]+/[^/]+/agg$ ]]; then
+    process_aggregate "$topic" "$value"
+  elif [[ "$topic" =~ ^/[^/]+/[^/]+/[^/]+/stats$ ]]; then
+    process_stats "$topic" "$value"
   # Check topic format: device/sensor/measurement
-  if [[ "$topic" =~ ^/[^/]+/[^/]+/[^/]+$ && "$value" =~ ^[0-9.]+$ ]]; then
+  elif [[ "$topic" =~ ^/[^/]+/[^/]+/[^/]+$ && "$value" =~ ^[0-9.]+(;[a-z]+=[0-9A-Za-z._-]+)*$ ]]; then
     process_message "$topic" "$value"
   else
     echo "Unknown topic: $topic"
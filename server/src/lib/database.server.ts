@@ -30,8 +30,26 @@ db.exec(`
         value_real REAL,
         FOREIGN KEY (sensor_id) REFERENCES sensor(id)
     );
+
+    CREATE TABLE IF NOT EXISTS sensor_sequence (
+        sensor_id INTEGER NOT NULL,
+        name VARCHAR(64) NOT NULL,
+        last_seq INTEGER NOT NULL,
+        received INTEGER NOT NULL DEFAULT 0,
+        lost_reported INTEGER NOT NULL DEFAULT 0,
+        lost_detected INTEGER NOT NULL DEFAULT 0,
+        restarts INTEGER NOT NULL DEFAULT 0,
+        PRIMARY KEY (sensor_id, name),
+        FOREIGN KEY (sensor_id) REFERENCES sensor(id)
+    );
 `)
 
+// Databases created before readings carried the edge sequence number
+const readingColumns = db.prepare("SELECT name FROM pragma_table_info('sensor_reading')").all() as { name: string }[];
+if (!readingColumns.some(column => column.name == "seq")) {
+    db.exec("ALTER TABLE sensor_reading ADD COLUMN seq INTEGER");
+}
+
 const addControllerQuery = db.prepare("INSERT INTO controller (name) VALUES (@name) ON CONFLICT DO NOTHING;");
 const addSensorQuery = db.prepare(`
     INSERT INTO sensor (controller_id, name) 
@@ -39,7 +57,7 @@ const addSensorQuery = db.prepare(`
     ON CONFLICT DO NOTHING;
 `);
 const addSensorReadingQuery = db.prepare(`
-    INSERT INTO sensor_reading (sensor_id, name, time_unix, value_str, value_int, value_real) 
+    INSERT INTO sensor_reading (sensor_id, name, time_unix, value_str, value_int, value_real, seq) 
     VALUES (
         (SELECT s.id FROM sensor s 
          JOIN controller c ON s.controller_id = c.id 
@@ -48,8 +66,36 @@ const addSensorReadingQuery = db.prepare(`
         @timeUnix,
         @valueStr, 
         @valueInt, 
-        @valueReal
+        @valueReal,
+        @seq
+    )
+`);
+const getSequenceQuery = db.prepare(`
+    SELECT sq.last_seq
+    FROM sensor_sequence sq
+    JOIN sensor s ON sq.sensor_id = s.id
+    JOIN controller c ON s.controller_id = c.id
+    WHERE c.name = @controllerName AND s.name = @sensorName AND sq.name = @streamName
+`);
+const upsertSequenceQuery = db.prepare(`
+    INSERT INTO sensor_sequence (sensor_id, name, last_seq, received, lost_reported, lost_detected, restarts)
+    VALUES (
+        (SELECT s.id FROM sensor s 
+         JOIN controller c ON s.controller_id = c.id 
+         WHERE c.name = @controllerName AND s.name = @sensorName),
+        @streamName,
+        @lastSeq,
+        @received,
+        @lostReported,
+        @lostDetected,
+        @restarted
     )
+    ON CONFLICT (sensor_id, name) DO UPDATE SET
+        last_seq = excluded.last_seq,
+        received = received + excluded.received,
+        lost_reported = lost_reported + excluded.lost_reported,
+        lost_detected = lost_detected + excluded.lost_detected,
+        restarts = restarts + excluded.restarts
 `);
 
 export function addController(name: string) {
@@ -63,7 +109,44 @@ export function addSensor(controller: string, name: string) {
     });
 }
 
-export function addSensorReading(controller: string, sensor: string, ts: number, name: string, value: any) {
+// Range of edge sequence numbers one submitted entry covers
+export interface SequenceRange {
+    stream?: string; // edge counter the numbers come from, e.g. "light/agg"
+    first: number;
+    last: number;
+    lost: number; // gaps the fog saw inside the range
+}
+
+// Updates the per stream counters. Numbers missing between the previous
+// range and this one never reached us, whether lost on the edge, on the
+// way to the fog or on the way here. Returns how many that was.
+export function addSequence(controller: string, sensor: string, stream: string, range: SequenceRange): number {
+    const previous = getSequenceQuery.get({
+        controllerName: controller,
+        sensorName: sensor,
+        streamName: stream
+    }) as { last_seq: number } | undefined;
+
+    // Going backwards means the edge restarted and counts from 0 again
+    const restarted = previous !== undefined && range.first <= previous.last_seq;
+    const lostDetected = previous !== undefined && !restarted
+        ? Math.max(0, range.first - previous.last_seq - 1)
+        : 0;
+
+    upsertSequenceQuery.run({
+        controllerName: controller,
+        sensorName: sensor,
+        streamName: stream,
+        lastSeq: range.last,
+        received: range.last - range.first + 1 - range.lost,
+        lostReported: range.lost,
+        lostDetected,
+        restarted: restarted ? 1 : 0
+    });
+    return lostDetected;
+}
+
+export function addSensorReading(controller: string, sensor: string, ts: number, name: string, value: any, seq: number | null = null) {
     let valueStr: string | null = null;
     let valueInt: number | null = null;
     let valueReal: number | null = null;
@@ -101,7 +184,8 @@ export function addSensorReading(controller: string, sensor: string, ts: number,
         timeUnix: ts, // Current Unix timestamp
         valueStr,
         valueInt,
-        valueReal
+        valueReal,
+        seq
     });
 }
 
@@ -407,5 +491,36 @@ export function getSensorReadingsInTimeRange(
     };
 }
 
+const getSequenceStatsQuery = db.prepare(`
+    SELECT 
+        c.name as controller_name,
+        s.name as sensor_name,
+        sq.name as stream_name,
+        sq.last_seq,
+        sq.received,
+        sq.lost_reported,
+        sq.lost_detected,
+        sq.restarts
+    FROM sensor_sequence sq
+    JOIN sensor s ON sq.sensor_id = s.id
+    JOIN controller c ON s.controller_id = c.id
+    WHERE @controllerName IS NULL OR c.name = @controllerName
+    ORDER BY c.name, s.name, sq.name
+`);
+
+interface SequenceStats {
+    controller_name: string;
+    sensor_name: string;
+    stream_name: string;
+    last_seq: number;
+    received: number;
+    lost_reported: number; // seen missing by the fog
+    lost_detected: number; // seen missing here, between submissions
+    restarts: number;
+}
+
+export function getSequenceStats(controllerName: string | null = null): SequenceStats[] {
+    return getSequenceStatsQuery.all({ controllerName }) as SequenceStats[];
+}
 
 export default db;
\ No newline at end of file
@@ -0,0 +1,11 @@
+import * as db  from "$lib/database.server"
+
+import { json } from '@sveltejs/kit';
+import type { RequestHandler } from './$types';
+
+
+// Sequence counters per stream, optionally for a single controller
+export const GET: RequestHandler = async ({ url }) => {
+    const controller = url.searchParams.get("controller");
+    return json(db.getSequenceStats(controller));
+};
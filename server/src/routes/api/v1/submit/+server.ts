@@ -12,14 +12,25 @@ export const POST: RequestHandler = async ({ request }) => {
         for (const entry of body.entries) {
             const controller = entry.controller;
             const timestamp = entry.timestamp;
+            const sequence: db.SequenceRange | undefined = entry.sequence;
             db.addController(controller);
             for (const sensor in entry) {
-                if (sensor == "controller" || sensor == "timestamp") continue;
+                if (sensor == "controller" || sensor == "timestamp" || sensor == "sequence") continue;
                 db.addSensor(controller, sensor);
                 const readings = entry[sensor];
+                if (sequence) {
+                    // Samples and aggregate windows are numbered apart on
+                    // the edge, older fogs only send the measurement
+                    const stream = sequence.stream ?? readings._type;
+                    const lost = db.addSequence(controller, sensor, stream, sequence);
+                    if (lost > 0) {
+                        console.warn(`${controller}/${sensor}/${stream}: ${lost} missing before ${sequence.first}`);
+                    }
+                }
                 for (const name in readings) {
-                    if (name == "_type") continue;
-                    db.addSensorReading(controller, sensor, parseInt(timestamp), name, readings[name]);
+                    // Metadata of the readings, not readings themselves
+                    if (name == "_type" || name == "unit") continue;
+                    db.addSensorReading(controller, sensor, parseInt(timestamp), name, readings[name], sequence?.last ?? null);
                 }
             }
 